@@ -33,6 +33,15 @@ protected:
 	Model MCar, MMike, MSkyBox, MFloor, MBullet, MGrass, MFence, MUpgrade, MTitle1, MTitle2, MTrophy;
 	Texture TGeneric, TMike, TSkyBox, TFloor, TCar, TBullet, TGrass, TFence, TUpgrade, TTitle1, TTitle2, TTrophy1, TTrophy2, TTrophy3;
 
+	// Draws of the models with levels of detail (slots in Utils.hpp) and the level each one uses
+	IndirectDraws LodDraws;
+	uint32_t carLod = 0, trophyLod = 0;
+	std::array<uint32_t, MAX_MIKE_INSTANCES> mikeLods{};
+	std::array<uint32_t, MAX_UPGRADE_INSTANCES> upgradeLods{};
+
+	// Load groups whose descriptor sets and draws exist, as of the last pipelinesAndDescriptorSetsInit()
+	std::array<bool, LOAD_GROUPS> groupSets{};
+
 	// Descriptor Sets
 	DescriptorSet DSGlobal, DSCar, DSSkyBox, DSFloor, DSGrass, DSFence, DSMikes, DSTitle1, DSTitle2, DSTrophy;
 	std::vector<DescriptorSet> DSBullets;
@@ -82,6 +91,9 @@ protected:
 	// Window resize handler
 	void onWindowResize(int w, int h) override;
 
+	// Queue asset loading, before the Vulkan device exists
+	void localLoad() override;
+
 	// Initialization of local resources
 	void localInit() override;
 
@@ -104,6 +116,11 @@ protected:
 
 	void initConstantUbos();
 
+	// Height in pixels of one unit seen at distance one, for Model::selectLod
+	float pixelsPerUnit(float fovy);
+	// Resolution asked for the textures that can cover the whole screen
+	float screenResolution();
+
 	// Function to generate a random position around the car within the floor boundaries
 	glm::vec3 generateRandomPosition(Car car, const float minRadius, const float maxRadius, std::mt19937 &rng, const float floorDiam);
 
@@ -11,6 +11,20 @@ constexpr auto FLOOR_DIAM = 128.0f; // multiple of 2
 constexpr auto NLIGHTS = MAX_MIKE_INSTANCES + 1;
 constexpr auto MAX_SPEED = 10.0f;
 
+// Slots of the indirect draws whose level of detail changes every frame
+constexpr auto DRAW_CAR = 0;
+constexpr auto DRAW_TROPHY = 1;
+constexpr auto DRAW_UPGRADES = 2;							 // one per upgrade
+constexpr auto DRAW_MIKES = DRAW_UPGRADES + MAX_UPGRADE_INSTANCES; // one per level of detail
+constexpr auto DRAW_SLOTS = DRAW_MIKES + MODEL_MAX_LODS;
+
+// Load groups: the assets of each scene. The title ones are loaded before the first frame,
+// the others in background while the title is shown
+constexpr auto LOAD_TITLE = 0;
+constexpr auto LOAD_GAMEPLAY = 1;
+constexpr auto LOAD_GAME_OVER = 2;
+constexpr auto LOAD_GROUPS = 3;
+
 // Uniform buffer object for toon shading
 struct ToonUniformBufferObject
 {
@@ -71,12 +85,12 @@ struct GlobalUniformBufferObject
 	} type[NLIGHTS]; // 0 global, 1 point
 };
 
-// Vertex structure for generic objects
+// Vertex structure for generic objects, quantized by Model::quantize (16 bytes instead of 32)
 struct GenericVertex
 {
-	glm::vec3 pos;	// Position
-	glm::vec3 norm; // Normal
-	glm::vec2 UV;	// Texture coordinates
+	int16_t pos[4];	 // Position, snorm in the bounding box of the mesh (see Model::Qm)
+	int16_t norm[2]; // Normal, octahedral encoding in snorm
+	uint16_t UV[2];	 // Texture coordinates, unorm
 };
 
 // Vertex structure for skybox
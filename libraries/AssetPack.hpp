@@ -0,0 +1,168 @@
+#pragma once
+// Asset pack: the models, textures and shaders of the game bundled into one file, written by
+// tools/AssetCook.cpp and mapped once at startup by mountAssetPack (starter.hpp).
+// Layout: a header, an index of entries, the names of the entries, then the payloads. Every
+// payload starts on a payloadAlignment boundary, so a span of the mapped pack can be copied
+// into a staging buffer as it is. The pack is written for the machine that reads it (native
+// byte order), like the mesh caches it contains.
+// This file does not depend on Vulkan, so that the tools can be built without it.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 64-bit FNV-1a, used to validate cooked asset caches and pack entries against their sources
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+namespace AssetPack {
+
+static const uint32_t version = 1;
+static const uint64_t payloadAlignment = 256;	// >= any optimalBufferCopyOffsetAlignment
+
+enum Type : uint32_t {
+	TYPE_OTHER = 0,
+	TYPE_MODEL = 1,			// OBJ, glTF, MGCG
+	TYPE_MODEL_CACHE = 2,	// .cache written by Model::saveCache
+	TYPE_IMAGE = 3,			// PNG, JPEG
+	TYPE_KTX2 = 4,			// block compressed, see Ktx2.hpp
+	TYPE_SHADER = 5,		// SPIR-V
+	TYPE_ATLAS = 6			// .atlas manifest written by AtlasCook
+};
+
+struct Header {
+	char magic[4];			// "MGPK"
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t namesSize;		// bytes of names after the index
+};
+
+struct Entry {
+	uint64_t offset;		// of the payload, from the start of the pack
+	uint64_t size;
+	uint64_t hash;			// hashBytes of the payload
+	uint32_t type;
+	uint32_t nameOffset;	// in the names block
+	uint32_t nameLength;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 16, "AssetPack::Header must not be padded");
+static_assert(sizeof(Entry) == 40, "AssetPack::Entry must not be padded");
+
+// Assets are looked up by the relative path the game uses for the loose file, with '/' separators
+inline std::string normalizeName(const std::string& name) {
+	return std::filesystem::path(name).lexically_normal().generic_string();
+}
+
+inline Type typeFromName(const std::string& name) {
+	std::string ext = std::filesystem::path(name).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	if (ext == ".obj" || ext == ".gltf" || ext == ".mgcg") return TYPE_MODEL;
+	if (ext == ".cache") return TYPE_MODEL_CACHE;
+	if (ext == ".png" || ext == ".jpg" || ext == ".jpeg") return TYPE_IMAGE;
+	if (ext == ".ktx2") return TYPE_KTX2;
+	if (ext == ".spv") return TYPE_SHADER;
+	if (ext == ".atlas") return TYPE_ATLAS;
+	return TYPE_OTHER;
+}
+
+inline const char* typeName(uint32_t type) {
+	switch (type) {
+	case TYPE_MODEL: return "model";
+	case TYPE_MODEL_CACHE: return "mesh cache";
+	case TYPE_IMAGE: return "image";
+	case TYPE_KTX2: return "KTX2";
+	case TYPE_SHADER: return "shader";
+	case TYPE_ATLAS: return "atlas manifest";
+	default: return "other";
+	}
+}
+
+// Reads the index of a pack held in memory, calling visit(name, entry) for each asset.
+// Throws std::runtime_error if the pack is malformed.
+template <typename Visitor>
+inline void parse(const unsigned char* data, size_t size, Visitor visit) {
+	Header H;
+	if (size < sizeof(H)) {
+		throw std::runtime_error("not an asset pack");
+	}
+	memcpy(&H, data, sizeof(H));
+	if (memcmp(H.magic, "MGPK", 4) != 0) {
+		throw std::runtime_error("not an asset pack");
+	}
+	if (H.version != version) {
+		throw std::runtime_error("asset pack version " + std::to_string(H.version) + " not supported");
+	}
+	size_t namesOffset = sizeof(H) + (size_t)H.entryCount * sizeof(Entry);
+	if (namesOffset > size || H.namesSize > size - namesOffset) {
+		throw std::runtime_error("truncated asset pack index");
+	}
+	const char* names = (const char*)data + namesOffset;
+	for (uint32_t i = 0; i < H.entryCount; i++) {
+		Entry E;
+		memcpy(&E, data + sizeof(H) + i * sizeof(Entry), sizeof(E));
+		if ((uint64_t)E.nameOffset + E.nameLength > H.namesSize ||
+			E.offset > size || E.size > size - E.offset || E.offset % payloadAlignment != 0) {
+			throw std::runtime_error("bad asset pack entry " + std::to_string(i));
+		}
+		visit(std::string(names + E.nameOffset, E.nameLength), E);
+	}
+}
+
+struct Source {
+	std::string name;
+	std::vector<unsigned char> data;
+};
+
+// Writes the assets in the given order
+inline void write(std::ostream& out, const std::vector<Source>& assets) {
+	Header H{};
+	memcpy(H.magic, "MGPK", 4);
+	H.version = version;
+	H.entryCount = (uint32_t)assets.size();
+
+	std::string names;
+	std::vector<Entry> entries(assets.size());
+	for (size_t i = 0; i < assets.size(); i++) {
+		entries[i].nameOffset = (uint32_t)names.size();
+		entries[i].nameLength = (uint32_t)assets[i].name.size();
+		entries[i].type = typeFromName(assets[i].name);
+		entries[i].size = assets[i].data.size();
+		entries[i].hash = hashBytes(assets[i].data.data(), assets[i].data.size());
+		names += assets[i].name;
+	}
+	H.namesSize = (uint32_t)names.size();
+
+	uint64_t offset = sizeof(H) + entries.size() * sizeof(Entry) + names.size();
+	for (Entry& E : entries) {
+		offset = (offset + payloadAlignment - 1) / payloadAlignment * payloadAlignment;
+		E.offset = offset;
+		offset += E.size;
+	}
+
+	out.write((const char*)&H, sizeof(H));
+	out.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+	out.write(names.data(), names.size());
+	uint64_t written = sizeof(H) + entries.size() * sizeof(Entry) + names.size();
+	for (size_t i = 0; i < assets.size(); i++) {
+		static const char zeros[payloadAlignment] = {};
+		out.write(zeros, (std::streamsize)(entries[i].offset - written));
+		out.write((const char*)assets[i].data.data(), assets[i].data.size());
+		written = entries[i].offset + entries[i].size;
+	}
+}
+
+}
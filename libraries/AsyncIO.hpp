@@ -0,0 +1,512 @@
+#pragma once
+// Asynchronous whole-file reads. The game uses them to read the loose asset files ahead of the
+// loader jobs that decode them (BaseProject::prefetchAsset, starter.hpp), and
+// tools/AsyncIOBenchmark.cpp measures them.
+// On Linux the reads go through io_uring, without liburing (raw system calls). One service
+// thread puts every queued read into a single submission. The reads are split into chunks,
+// read into a pool of registered buffers (IORING_OP_READ_FIXED). Each file's callback is called
+// as soon as its last chunk arrives, so a decode job can start while later files are still
+// being read. Without io_uring (older kernels, seccomp filters, locked memory limits, other
+// systems) a few threads read the files with pread, or with std::ifstream on Windows.
+// This file does not depend on Vulkan, so that the tools can be built without it.
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#define ASYNCIO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+namespace AsyncIO {
+
+// Called once per file, on a thread of the reader, with the whole contents. The callback may
+// take the data (swap it out); ok is false when the file cannot be read
+using Callback = std::function<void(const std::string& file, std::vector<unsigned char>& data, bool ok)>;
+
+enum Backend {
+	BACKEND_NONE,
+	BACKEND_URING,
+	BACKEND_PREAD
+};
+
+class Reader {
+public:
+	~Reader() { stop(); }
+
+	// queueDepth reads of chunkSize bytes are in flight at most, in as many registered buffers.
+	// Falls back to preadThreads threads when io_uring is not allowed or not available
+	void start(bool allowUring = true, unsigned queueDepth = 16, size_t chunkSize = 256 << 10,
+		unsigned preadThreads = 4);
+	// Queues the read of a whole file; thread safe
+	void read(const std::string& file, Callback done);
+	// Waits for the reads queued so far
+	void wait();
+	// Reads that did not start yet complete with ok = false, the others are waited for
+	void stop();
+
+	Backend backend() const { return mode; }
+	const char* backendName() const;
+	// why io_uring is not used, empty when it is
+	const std::string& fallbackReason() const { return reason; }
+
+private:
+	struct Request {
+		std::string file;
+		Callback done;
+	};
+
+	std::mutex mtx;
+	std::condition_variable requestReady;
+	std::condition_variable allDone;
+	std::deque<Request> requests;
+	size_t pending = 0;		// queued or in flight
+	bool quitting = false;
+	Backend mode = BACKEND_NONE;
+	std::string reason;
+	std::vector<std::thread> threads;
+
+	bool nextRequest(Request& R, bool block);
+	void complete(Request& R, std::vector<unsigned char>& data, bool ok);
+	static bool readWhole(const std::string& file, std::vector<unsigned char>& data);
+	void preadLoop();
+
+#ifdef ASYNCIO_URING
+	struct File {
+		Request request;
+		int fd = -1;
+		std::vector<unsigned char> data;
+		uint64_t submitted = 0;		// bytes handed to the ring
+		uint64_t received = 0;
+		unsigned inFlight = 0;
+		bool failed = false;
+	};
+	struct Chunk {
+		File* file;
+		uint64_t offset;
+		uint32_t length;
+	};
+
+	int ringFd = -1;
+	void* sqRing = nullptr;
+	void* cqRing = nullptr;
+	size_t sqRingSize = 0;
+	size_t cqRingSize = 0;
+	io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	io_uring_cqe* cqes;
+	size_t chunkBytes = 0;
+	std::vector<unsigned char> buffers;		// registered, chunkBytes per slot
+	std::vector<Chunk> slots;
+	std::vector<unsigned> freeSlots;
+
+	bool setupRing(unsigned queueDepth, size_t chunkSize);
+	void closeRing();
+	void uringLoop();
+	void finishFile(File* F);
+#endif
+};
+
+inline const char* Reader::backendName() const {
+	switch (mode) {
+	case BACKEND_URING: return "io_uring";
+	case BACKEND_PREAD: return "pread";
+	default: return "none";
+	}
+}
+
+inline void Reader::start(bool allowUring, unsigned queueDepth, size_t chunkSize, unsigned preadThreads) {
+	stop();
+	quitting = false;
+	reason.clear();
+#ifdef ASYNCIO_URING
+	if (!allowUring) {
+		reason = "disabled";
+	}
+	else if (setupRing(queueDepth, chunkSize)) {
+		mode = BACKEND_URING;
+		threads.emplace_back(&Reader::uringLoop, this);
+		return;
+	}
+#else
+	(void)queueDepth;
+	(void)chunkSize;
+	reason = allowUring ? "not available on this system" : "disabled";
+#endif
+	mode = BACKEND_PREAD;
+	for (unsigned i = 0; i < (preadThreads ? preadThreads : 1); i++) {
+		threads.emplace_back(&Reader::preadLoop, this);
+	}
+}
+
+inline void Reader::read(const std::string& file, Callback done) {
+	std::unique_lock<std::mutex> lock(mtx);
+	if (mode == BACKEND_NONE || quitting) {
+		lock.unlock();
+		std::vector<unsigned char> none;
+		done(file, none, false);
+		return;
+	}
+	requests.push_back({ file, std::move(done) });
+	pending++;
+	requestReady.notify_one();
+}
+
+inline void Reader::wait() {
+	std::unique_lock<std::mutex> lock(mtx);
+	allDone.wait(lock, [this] { return pending == 0; });
+}
+
+inline void Reader::stop() {
+	std::deque<Request> dropped;
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		quitting = true;
+		dropped.swap(requests);
+		requestReady.notify_all();
+	}
+	for (Request& R : dropped) {
+		std::vector<unsigned char> none;
+		complete(R, none, false);
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	threads.clear();
+#ifdef ASYNCIO_URING
+	closeRing();
+#endif
+	mode = BACKEND_NONE;
+}
+
+// Next queued request; without block, returns false at once when there is none
+inline bool Reader::nextRequest(Request& R, bool block) {
+	std::unique_lock<std::mutex> lock(mtx);
+	if (block) {
+		requestReady.wait(lock, [this] { return quitting || !requests.empty(); });
+	}
+	if (requests.empty()) {
+		return false;
+	}
+	R = std::move(requests.front());
+	requests.pop_front();
+	return true;
+}
+
+inline void Reader::complete(Request& R, std::vector<unsigned char>& data, bool ok) {
+	R.done(R.file, data, ok);
+	std::unique_lock<std::mutex> lock(mtx);
+	if (--pending == 0) {
+		allDone.notify_all();
+	}
+}
+
+inline bool Reader::readWhole(const std::string& file, std::vector<unsigned char>& data) {
+#ifndef _WIN32
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok) {
+		data.resize((size_t)st.st_size);
+		size_t done = 0;
+		while (ok && done < data.size()) {
+			ssize_t n = pread(fd, data.data() + done, data.size() - done, (off_t)done);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			ok = n > 0;
+			done += ok ? (size_t)n : 0;
+		}
+	}
+	::close(fd);
+	return ok;
+#else
+	std::ifstream in(file, std::ios::ate | std::ios::binary);
+	if (!in.is_open()) {
+		return false;
+	}
+	data.resize((size_t)in.tellg());
+	in.seekg(0);
+	in.read((char*)data.data(), data.size());
+	return in.good();
+#endif
+}
+
+inline void Reader::preadLoop() {
+	Request R;
+	while (nextRequest(R, true)) {
+		std::vector<unsigned char> data;
+		bool ok = readWhole(R.file, data);
+		complete(R, data, ok);
+	}
+}
+
+#ifdef ASYNCIO_URING
+
+inline bool Reader::setupRing(unsigned queueDepth, size_t chunkSize) {
+	io_uring_params p{};
+	ringFd = (int)syscall(__NR_io_uring_setup, queueDepth, &p);
+	if (ringFd < 0) {
+		reason = std::string("io_uring_setup: ") + strerror(errno);
+		return false;
+	}
+
+	sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single) {
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	}
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	cqRing = single ? sqRing :
+		mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+	void* sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqeMap == MAP_FAILED) {
+		reason = "cannot map the io_uring rings";
+		if (sqRing == MAP_FAILED) sqRing = nullptr;
+		if (cqRing == MAP_FAILED) cqRing = nullptr;
+		if (sqeMap != MAP_FAILED) munmap(sqeMap, sqesSize);
+		closeRing();
+		return false;
+	}
+	sqes = (io_uring_sqe*)sqeMap;
+
+	unsigned char* sq = (unsigned char*)sqRing;
+	unsigned char* cq = (unsigned char*)cqRing;
+	sqHead = (unsigned*)(sq + p.sq_off.head);
+	sqTail = (unsigned*)(sq + p.sq_off.tail);
+	sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+	sqArray = (unsigned*)(sq + p.sq_off.array);
+	cqHead = (unsigned*)(cq + p.cq_off.head);
+	cqTail = (unsigned*)(cq + p.cq_off.tail);
+	cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+	cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	// the buffers are pinned once, instead of at every read
+	chunkBytes = chunkSize;
+	buffers.resize(chunkBytes * queueDepth);
+	std::vector<iovec> iovs(queueDepth);
+	for (unsigned i = 0; i < queueDepth; i++) {
+		iovs[i].iov_base = buffers.data() + i * chunkBytes;
+		iovs[i].iov_len = chunkBytes;
+	}
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iovs.data(), queueDepth) < 0) {
+		reason = std::string("cannot register the read buffers: ") + strerror(errno);
+		closeRing();
+		return false;
+	}
+	slots.assign(queueDepth, Chunk{ nullptr, 0, 0 });
+	freeSlots.clear();
+	for (unsigned i = queueDepth; i > 0; i--) {
+		freeSlots.push_back(i - 1);
+	}
+	return true;
+}
+
+inline void Reader::closeRing() {
+	if (sqes) munmap(sqes, sqesSize);
+	if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+	if (sqRing) munmap(sqRing, sqRingSize);
+	if (ringFd >= 0) ::close(ringFd);
+	sqes = nullptr;
+	sqRing = cqRing = nullptr;
+	ringFd = -1;
+	buffers.clear();
+	buffers.shrink_to_fit();
+	slots.clear();
+	freeSlots.clear();
+}
+
+inline void Reader::finishFile(File* F) {
+	if (F->fd >= 0) {
+		::close(F->fd);
+	}
+	complete(F->request, F->data, !F->failed);
+	delete F;
+}
+
+inline void Reader::uringLoop() {
+	std::deque<File*> files;	// with chunks left to submit, in request order
+	unsigned inFlight = 0;		// chunks taken by the kernel
+	unsigned unsubmitted = 0;	// chunks queued in the submission ring, not taken yet
+	bool broken = false;
+
+	while (true) {
+		// new requests: blocks only when nothing is in flight
+		Request R;
+		while (nextRequest(R, inFlight == 0 && unsubmitted == 0 && files.empty())) {
+			File* F = new File();
+			F->request = std::move(R);
+			F->fd = ::open(F->request.file.c_str(), O_RDONLY);
+			struct stat st;
+			if (F->fd < 0 || fstat(F->fd, &st) != 0) {
+				F->failed = true;
+				finishFile(F);
+				continue;
+			}
+			F->data.resize((size_t)st.st_size);
+			if (F->data.empty()) {
+				finishFile(F);
+				continue;
+			}
+			files.push_back(F);
+		}
+		if (inFlight == 0 && unsubmitted == 0 && files.empty()) {
+			std::unique_lock<std::mutex> lock(mtx);
+			if (quitting && requests.empty()) {
+				return;
+			}
+			continue;
+		}
+
+		if (broken) {
+			// the ring failed: the files left are read in place
+			for (File* F : files) {
+				F->failed = !readWhole(F->request.file, F->data);
+				finishFile(F);
+			}
+			files.clear();
+			continue;
+		}
+
+		// one chunk per free buffer, the earliest files first so that they complete first
+		unsigned toSubmit = 0;
+		while (!freeSlots.empty() && !files.empty()) {
+			File* F = files.front();
+			unsigned slot = freeSlots.back();
+			freeSlots.pop_back();
+			uint32_t length = (uint32_t)std::min<uint64_t>(chunkBytes, F->data.size() - F->submitted);
+			slots[slot] = { F, F->submitted, length };
+			F->submitted += length;
+			F->inFlight++;
+			if (F->submitted == F->data.size()) {
+				files.pop_front();
+			}
+
+			unsigned tail = *sqTail;
+			unsigned index = tail & *sqMask;
+			io_uring_sqe* e = &sqes[index];
+			memset(e, 0, sizeof(*e));
+			e->opcode = IORING_OP_READ_FIXED;
+			e->fd = F->fd;
+			e->addr = (uint64_t)(uintptr_t)(buffers.data() + (size_t)slot * chunkBytes);
+			e->len = length;
+			e->off = slots[slot].offset;
+			e->buf_index = (uint16_t)slot;
+			e->user_data = slot;
+			sqArray[index] = index;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+			toSubmit++;
+		}
+		unsubmitted += toSubmit;
+
+		// the kernel may take only some of the chunks (or none, with EAGAIN or EBUSY): the rest
+		// stay in the ring, and are submitted again on the next pass
+		int r = (int)syscall(__NR_io_uring_enter, ringFd, unsubmitted, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (r >= 0) {
+			unsubmitted -= std::min((unsigned)r, unsubmitted);
+			inFlight += (unsigned)r;
+		}
+		else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			// nothing more completes: fail the chunks still in flight
+			broken = true;
+			for (unsigned slot = 0; slot < slots.size(); slot++) {
+				File* F = slots[slot].file;
+				if (F == nullptr) {
+					continue;
+				}
+				slots[slot].file = nullptr;
+				freeSlots.push_back(slot);
+				F->failed = true;
+				if (--F->inFlight == 0 && F->submitted == F->data.size()) {
+					finishFile(F);
+				}
+			}
+			inFlight = 0;
+			unsubmitted = 0;
+			continue;
+		}
+		if (inFlight == 0) {
+			// nothing was taken and nothing completes: let the kernel free some resources
+			std::this_thread::yield();
+			continue;
+		}
+
+		unsigned head = *cqHead;
+		while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+			const io_uring_cqe& C = cqes[head & *cqMask];
+			unsigned slot = (unsigned)C.user_data;
+			Chunk chunk = slots[slot];
+			File* F = chunk.file;
+			head++;
+			inFlight--;
+			slots[slot].file = nullptr;
+			freeSlots.push_back(slot);
+			F->inFlight--;
+
+			if (C.res <= 0) {
+				F->failed = true;
+			}
+			else {
+				uint32_t got = (uint32_t)C.res;
+				memcpy(F->data.data() + chunk.offset, buffers.data() + (size_t)slot * chunkBytes, got);
+				F->received += got;
+				if (got < chunk.length) {
+					// short read: the rest is read in place, the file is not in the queue anymore
+					uint64_t offset = chunk.offset + got;
+					while (offset < chunk.offset + chunk.length) {
+						ssize_t n = pread(F->fd, F->data.data() + offset, chunk.offset + chunk.length - offset, (off_t)offset);
+						if (n < 0 && errno == EINTR) {
+							continue;
+						}
+						if (n <= 0) {
+							F->failed = true;
+							break;
+						}
+						offset += n;
+						F->received += n;
+					}
+				}
+			}
+			if (F->inFlight == 0 && F->submitted == F->data.size()) {
+				finishFile(F);
+			}
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	}
+}
+
+#endif
+
+}
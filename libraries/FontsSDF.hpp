@@ -0,0 +1,17 @@
+#pragma once
+// Distance field font written by FontCook from font 0 of Fonts.hpp: cook it again instead of
+// editing it. x, y, width and height are in texels of textures/FontsSDF.png, offsets and
+// advances in font units (texels of the source font), FONT_SDF_UNITS_PER_TEXEL per texel of
+// the field. The field stores 0.5 + d / (2 * FONT_SDF_SPREAD), d the signed distance in font
+// units from the outline of the glyph, positive inside.
+
+#include "Fonts.hpp"
+
+const int FONT_SDF_WIDTH = 512;
+const int FONT_SDF_HEIGHT = 512;
+const int FONT_SDF_UNITS_PER_TEXEL = 2;
+const float FONT_SDF_SPREAD = 10.0f;
+
+const FontDef FontSDF = { 73,{{0,0,0,0,0,0,21},{274,50,19,41,-6,-6,21},{411,219,25,25,-11,-6,26},{294,50,36,41,-14,-6,41},{179,0,33,47,-12,-10,41},{331,50,45,41,-12,-5,65},{255,0,37,42,-11,-6,49},{437,219,19,25,-9,-6,14},{0,0,24,49,-9,-7,24},{25,0,24,49,-12,-7,24},{457,219,27,25,-11,-6,29},{274,219,34,33,-11,9,43},{485,219,19,24,-8,38,21},{62,254,25,19,-11,22,24},{88,254,19,19,-8,38,21},{377,50,27,41,-14,-6,21},{405,50,33,41,-12,-5,41},{40,177,25,40,-7,-5,41},{66,177,33,40,-12,-5,41},{439,50,33,41,-12,-5,41},{100,177,34,40,-12,-5,41},{473,50,33,41,-12,-4,41},{0,93,33,41,-12,-5,41},{135,177,34,40,-12,-4,41},{34,93,33,41,-12,-5,41},{68,93,33,41,-12,-5,41},{382,177,19,34,-6,8,21},{195,177,19,39,-6,8,21},{402,177,36,34,-13,8,43},{341,219,34,26,-11,17,43},{439,177,36,34,-13,8,43},{102,93,32,41,-9,-7,41},
+{293,0,44,42,-6,-7,74},{135,93,39,41,-13,-6,49},{175,93,36,41,-9,-6,49},{338,0,39,42,-11,-7,52},{212,93,37,41,-8,-6,52},{250,93,35,41,-8,-6,49},{286,93,34,41,-8,-6,44},{378,0,40,42,-11,-7,57},{321,93,37,41,-9,-6,52},{359,93,19,41,-7,-6,21},{419,0,31,42,-13,-6,36},{379,93,37,41,-9,-6,49},{417,93,33,41,-9,-6,41},{451,93,41,41,-9,-6,60},{0,135,36,41,-9,-6,52},{451,0,41,42,-11,-7,57},{37,135,35,41,-8,-6,49},{213,0,41,44,-11,-7,57},{73,135,37,41,-8,-6,52},{0,50,37,42,-11,-7,49},{111,135,37,41,-13,-6,44},{38,50,36,42,-8,-6,52},{149,135,38,41,-12,-6,49},{188,135,49,41,-13,-6,68},{238,135,39,41,-13,-6,49},{278,135,39,41,-13,-6,49},{318,135,36,41,-13,-6,44},{131,0,23,48,-10,-6,21},{355,135,29,41,-17,-6,21},{155,0,23,48,-13,-6,21},{309,219,31,30,-10,-6,34},{108,254,36,17,-14,51,41},
+{38,254,23,20,-13,-7,24},{215,177,33,35,-11,7,41},{75,50,32,42,-10,-6,41},{249,177,32,35,-12,7,36},{108,50,32,42,-12,-6,41},{282,177,33,35,-12,7,41},{385,135,25,41,-13,-7,21},{141,50,32,42,-12,7,41},{411,135,31,41,-10,-6,41},{443,135,19,41,-10,-6,16},{50,0,22,49,-16,-6,16},{463,135,32,41,-10,-6,36},{0,177,19,41,-9,-6,16},{0,219,41,34,-10,7,60},{42,219,31,34,-10,7,41},{316,177,33,35,-12,7,41},{174,50,32,42,-10,7,41},{207,50,32,42,-12,7,41},{74,219,25,34,-9,7,24},{350,177,31,35,-12,7,36},{170,177,24,40,-13,-3,21},{100,219,31,34,-10,8,41},{132,219,33,34,-14,8,36},{166,219,41,34,-14,8,52},{208,219,33,34,-14,8,36},{240,50,33,42,-13,8,36},{242,219,31,34,-12,8,36},{73,0,28,49,-16,-7,25},{20,177,19,41,-9,-7,19},{102,0,28,49,-13,-7,25},{0,254,37,22,-14,20,43},{376,219,34,26,-11,17,43}} };
@@ -0,0 +1,250 @@
+#pragma once
+// Minimal KTX2 container support, for the block-compressed textures written by
+// tools/TextureCooker.cpp and read by Texture::loadTextureImages.
+// Only what the game needs is handled: 2D images (one face, or six for a cube), no array
+// layers, no supercompression, mip levels stored in the file. Formats are the VkFormat
+// enumerants, as plain numbers so that the tools can be built without the Vulkan headers.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Ktx2 {
+
+enum Format : uint32_t {
+	FORMAT_BC1_RGB_UNORM = 131,
+	FORMAT_BC1_RGB_SRGB = 132,
+	FORMAT_BC1_RGBA_UNORM = 133,
+	FORMAT_BC1_RGBA_SRGB = 134,
+	FORMAT_BC3_UNORM = 137,
+	FORMAT_BC3_SRGB = 138,
+	FORMAT_BC7_UNORM = 145,
+	FORMAT_BC7_SRGB = 146
+};
+
+// Bytes per 4x4 block, 0 for the formats that are not supported
+inline uint32_t blockBytes(uint32_t vkFormat) {
+	switch (vkFormat) {
+	case FORMAT_BC1_RGB_UNORM:
+	case FORMAT_BC1_RGB_SRGB:
+	case FORMAT_BC1_RGBA_UNORM:
+	case FORMAT_BC1_RGBA_SRGB:
+		return 8;
+	case FORMAT_BC3_UNORM:
+	case FORMAT_BC3_SRGB:
+	case FORMAT_BC7_UNORM:
+	case FORMAT_BC7_SRGB:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+inline bool isSrgb(uint32_t vkFormat) {
+	// each supported format is an odd UNORM enumerant followed by its SRGB twin
+	return blockBytes(vkFormat) != 0 && (vkFormat % 2) == 0;
+}
+
+// The same block format, read as sRGB or as linear data
+inline uint32_t withColorSpace(uint32_t vkFormat, bool srgb) {
+	if (isSrgb(vkFormat) == srgb) {
+		return vkFormat;
+	}
+	return srgb ? vkFormat + 1 : vkFormat - 1;
+}
+
+inline const char* formatName(uint32_t vkFormat) {
+	switch (vkFormat) {
+	case FORMAT_BC1_RGB_UNORM: case FORMAT_BC1_RGB_SRGB: return "BC1";
+	case FORMAT_BC1_RGBA_UNORM: case FORMAT_BC1_RGBA_SRGB: return "BC1A";
+	case FORMAT_BC3_UNORM: case FORMAT_BC3_SRGB: return "BC3";
+	case FORMAT_BC7_UNORM: case FORMAT_BC7_SRGB: return "BC7";
+	default: return "unsupported";
+	}
+}
+
+struct Level {
+	uint64_t offset;	// in the file
+	uint64_t size;		// all faces
+	uint32_t width;
+	uint32_t height;
+};
+
+struct Image {
+	uint32_t vkFormat = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t faces = 0;
+	std::vector<Level> levels;	// level 0 (full size) first
+};
+
+static const unsigned char identifier[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+static const size_t headerSize = 80;
+static const size_t levelIndexEntrySize = 24;
+
+template <typename T>
+inline T readLE(const unsigned char* p) {
+	T v = 0;
+	for (size_t i = 0; i < sizeof(T); i++) {
+		v |= (T)p[i] << (8 * i);
+	}
+	return v;
+}
+
+template <typename T>
+inline void writeLE(std::vector<unsigned char>& out, T v) {
+	for (size_t i = 0; i < sizeof(T); i++) {
+		out.push_back((unsigned char)(v >> (8 * i)));
+	}
+}
+
+// Reads the header and the level index of a KTX2 file held in memory.
+// Throws std::runtime_error if the file is malformed or uses features not supported here.
+inline Image parse(const unsigned char* data, size_t size) {
+	if (size < headerSize || memcmp(data, identifier, sizeof(identifier)) != 0) {
+		throw std::runtime_error("not a KTX2 file");
+	}
+	Image I;
+	I.vkFormat = readLE<uint32_t>(data + 12);
+	I.width = readLE<uint32_t>(data + 20);
+	I.height = readLE<uint32_t>(data + 24);
+	uint32_t depth = readLE<uint32_t>(data + 28);
+	uint32_t layers = readLE<uint32_t>(data + 32);
+	I.faces = readLE<uint32_t>(data + 36);
+	uint32_t levelCount = std::max<uint32_t>(readLE<uint32_t>(data + 40), 1);
+	uint32_t supercompression = readLE<uint32_t>(data + 44);
+
+	if (blockBytes(I.vkFormat) == 0) {
+		throw std::runtime_error("KTX2 format " + std::to_string(I.vkFormat) + " not supported");
+	}
+	if (supercompression != 0) {
+		throw std::runtime_error("KTX2 supercompression not supported");
+	}
+	if (depth > 1 || layers > 1 || (I.faces != 1 && I.faces != 6) || I.width == 0 || I.height == 0) {
+		throw std::runtime_error("only 2D and cube KTX2 images are supported");
+	}
+	if (headerSize + (size_t)levelCount * levelIndexEntrySize > size) {
+		throw std::runtime_error("truncated KTX2 level index");
+	}
+
+	const unsigned char* index = data + headerSize;
+	for (uint32_t i = 0; i < levelCount; i++) {
+		Level L;
+		L.offset = readLE<uint64_t>(index + i * levelIndexEntrySize);
+		L.size = readLE<uint64_t>(index + i * levelIndexEntrySize + 8);
+		L.width = std::max<uint32_t>(I.width >> i, 1);
+		L.height = std::max<uint32_t>(I.height >> i, 1);
+		uint64_t expected = (uint64_t)((L.width + 3) / 4) * ((L.height + 3) / 4) *
+			blockBytes(I.vkFormat) * I.faces;
+		if (L.size != expected || L.offset > size || L.size > size - L.offset) {
+			throw std::runtime_error("bad KTX2 level " + std::to_string(i));
+		}
+		I.levels.push_back(L);
+	}
+	return I;
+}
+
+// Basic data format descriptor for the block formats above
+inline std::vector<unsigned char> makeDescriptor(uint32_t vkFormat) {
+	struct Sample { uint16_t bitOffset; uint8_t bitLength; uint8_t channel; };
+	std::vector<Sample> samples;
+	uint8_t colorModel;
+	switch (blockBytes(vkFormat) == 8 ? FORMAT_BC1_RGB_UNORM : withColorSpace(vkFormat, false)) {
+	case FORMAT_BC1_RGB_UNORM:
+		colorModel = 128;	// KHR_DF_MODEL_BC1A
+		samples.push_back({ 0, 63, (uint8_t)(vkFormat >= FORMAT_BC1_RGBA_UNORM ? 1 : 0) });
+		break;
+	case FORMAT_BC3_UNORM:
+		colorModel = 130;	// KHR_DF_MODEL_BC3
+		samples.push_back({ 0, 63, 15 });
+		samples.push_back({ 64, 63, 0 });
+		break;
+	default:
+		colorModel = 134;	// KHR_DF_MODEL_BC7
+		samples.push_back({ 0, 127, 0 });
+		break;
+	}
+
+	std::vector<unsigned char> dfd;
+	uint16_t blockSize = (uint16_t)(24 + 16 * samples.size());
+	writeLE<uint32_t>(dfd, 4 + blockSize);		// dfdTotalSize
+	writeLE<uint32_t>(dfd, 0);					// vendorId, descriptorType: Khronos basic
+	writeLE<uint16_t>(dfd, 2);					// versionNumber
+	writeLE<uint16_t>(dfd, blockSize);
+	dfd.push_back(colorModel);
+	dfd.push_back(1);							// BT.709 primaries
+	dfd.push_back(isSrgb(vkFormat) ? 2 : 1);	// sRGB or linear transfer
+	dfd.push_back(0);							// straight alpha
+	const unsigned char blockDimension[4] = { 3, 3, 0, 0 };
+	dfd.insert(dfd.end(), blockDimension, blockDimension + 4);
+	dfd.push_back((unsigned char)blockBytes(vkFormat));
+	dfd.insert(dfd.end(), 7, 0);
+	for (const Sample& S : samples) {
+		writeLE<uint16_t>(dfd, S.bitOffset);
+		dfd.push_back(S.bitLength);
+		dfd.push_back(S.channel);
+		writeLE<uint32_t>(dfd, 0);				// sample position
+		writeLE<uint32_t>(dfd, 0);				// lower
+		writeLE<uint32_t>(dfd, 0xFFFFFFFFu);	// upper
+	}
+	return dfd;
+}
+
+// Writes a single-face image. levels[i] holds the blocks of mip level i, level 0 first.
+inline void write(std::ostream& out, uint32_t vkFormat, uint32_t width, uint32_t height,
+	const std::vector<std::vector<unsigned char>>& levels) {
+	uint32_t levelCount = (uint32_t)levels.size();
+	std::vector<unsigned char> dfd = makeDescriptor(vkFormat);
+	size_t dfdOffset = headerSize + levelCount * levelIndexEntrySize;
+
+	// Level data goes from the smallest level to the largest one, each aligned to the block size
+	size_t alignment = blockBytes(vkFormat);
+	std::vector<uint64_t> offsets(levelCount);
+	uint64_t offset = dfdOffset + dfd.size();
+	for (uint32_t i = levelCount; i-- > 0; ) {
+		offset = (offset + alignment - 1) / alignment * alignment;
+		offsets[i] = offset;
+		offset += levels[i].size();
+	}
+
+	std::vector<unsigned char> head(identifier, identifier + sizeof(identifier));
+	writeLE<uint32_t>(head, vkFormat);
+	writeLE<uint32_t>(head, 1);				// typeSize
+	writeLE<uint32_t>(head, width);
+	writeLE<uint32_t>(head, height);
+	writeLE<uint32_t>(head, 0);				// pixelDepth
+	writeLE<uint32_t>(head, 0);				// layerCount
+	writeLE<uint32_t>(head, 1);				// faceCount
+	writeLE<uint32_t>(head, levelCount);
+	writeLE<uint32_t>(head, 0);				// supercompressionScheme
+	writeLE<uint32_t>(head, (uint32_t)dfdOffset);
+	writeLE<uint32_t>(head, (uint32_t)dfd.size());
+	writeLE<uint32_t>(head, 0);				// no key/value data
+	writeLE<uint32_t>(head, 0);
+	writeLE<uint64_t>(head, 0);				// no supercompression global data
+	writeLE<uint64_t>(head, 0);
+	for (uint32_t i = 0; i < levelCount; i++) {
+		writeLE<uint64_t>(head, offsets[i]);
+		writeLE<uint64_t>(head, levels[i].size());
+		writeLE<uint64_t>(head, levels[i].size());
+	}
+	head.insert(head.end(), dfd.begin(), dfd.end());
+	out.write((const char*)head.data(), head.size());
+
+	uint64_t written = head.size();
+	for (uint32_t i = levelCount; i-- > 0; ) {
+		static const char zeros[16] = {};
+		out.write(zeros, (std::streamsize)(offsets[i] - written));
+		out.write((const char*)levels[i].data(), levels[i].size());
+		written = offsets[i] + levels[i].size();
+	}
+}
+
+}
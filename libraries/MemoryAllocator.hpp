@@ -0,0 +1,467 @@
+#pragma once
+// Device memory sub-allocator: BaseProject::createBuffer and createImage take their memory from
+// here instead of calling vkAllocateMemory once per resource.
+// Memory is allocated in blocks (blockSize bytes, less on small heaps), one pool of blocks per
+// memory type and strategy:
+// - STRATEGY_BUDDY: power-of-two buddy allocator, for resources freed in any order (textures,
+//   meshes, uniform and indirect buffers); alignment comes for free with the power-of-two
+//   offsets, and freed ranges merge back with their buddy;
+// - STRATEGY_LINEAR: bump allocator, for short-lived resources freed roughly in allocation
+//   order (staging buffers); a block starts over when all its allocations are freed.
+// Resources larger than half a block get a dedicated allocation.
+// bufferImageGranularity: when the device has one larger than 1, buffers and linear images
+// never share a block with optimal images (separate pools), so neighbors in a block are always
+// of the same kind and need no extra padding.
+// Host-visible blocks are mapped once for their whole life: Allocation::mapped points to the
+// bytes of the allocation, with no vkMapMemory per use. Writes to memory that is not
+// HOST_COHERENT must be made visible with flush().
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+enum AllocationStrategy {
+	STRATEGY_BUDDY = 0,
+	STRATEGY_LINEAR = 1
+};
+
+enum ResourceKind {
+	RESOURCE_LINEAR = 0,		// buffers and images with VK_IMAGE_TILING_LINEAR
+	RESOURCE_OPTIMAL = 1		// images with VK_IMAGE_TILING_OPTIMAL
+};
+
+struct MemoryBlock;
+
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;		// as requested
+	void* mapped = nullptr;		// host-visible memory only
+	MemoryBlock* block = nullptr;	// nullptr for dedicated allocations
+	uint32_t order = 0;			// buddy allocations: log2 of the range
+	uint32_t memoryType = 0;
+};
+
+struct MemoryBlock {
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	void* mapped;
+	AllocationStrategy strategy;
+	uint32_t pool;
+	uint32_t live = 0;			// allocations in the block
+	VkDeviceSize used = 0;		// bytes requested by them
+	VkDeviceSize reserved = 0;	// bytes taken from the block (after rounding and alignment)
+	// buddy: free offsets per order, from minOrder
+	std::vector<std::set<VkDeviceSize>> freeRanges;
+	// linear: first free byte
+	VkDeviceSize top = 0;
+};
+
+struct MemoryStats {
+	uint32_t blocks = 0;
+	uint32_t dedicated = 0;
+	uint32_t allocations = 0;		// sub-allocations and dedicated ones
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	VkDeviceSize usedBytes = 0;		// requested by the resources in blocks
+	VkDeviceSize reservedBytes = 0;	// taken from the blocks: used plus rounding and alignment
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFree = 0;	// largest single range that can still be allocated
+	// 0 when the free bytes are one range, towards 1 as they split into small ones
+	float fragmentation() const {
+		return freeBytes ? 1.0f - (float)largestFree / (float)freeBytes : 0.0f;
+	}
+};
+
+class MemoryAllocator {
+public:
+	~MemoryAllocator() { cleanup(); }
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = 64ull << 20);
+	// Throws std::runtime_error when no memory type fits, or the memory is exhausted
+	Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+		ResourceKind kind, AllocationStrategy strategy = STRATEGY_BUDDY);
+	void free(Allocation& A);
+	// Makes the host writes to bytes [offset, offset + size) of A visible to the device;
+	// nothing to do on HOST_COHERENT memory
+	void flush(const Allocation& A, VkDeviceSize offset, VkDeviceSize size) const;
+	bool isCoherent(const Allocation& A) const;
+	// Frees the blocks; every allocation must have been freed before
+	void cleanup();
+
+	MemoryStats stats() const;
+	void printStats(std::ostream& out) const;
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+private:
+	static const uint32_t minOrder = 8;		// 256 bytes
+
+	struct Pool {
+		uint32_t memoryType;
+		ResourceKind kind;
+		AllocationStrategy strategy;
+		VkDeviceSize blockSize;
+		std::vector<MemoryBlock*> blocks;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize granularity = 1;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	uint32_t maxAllocations = 0;
+	VkDeviceSize defaultBlockSize = 0;
+	mutable std::mutex mtx;
+	std::vector<Pool> pools;
+	std::map<std::tuple<uint32_t, int, int>, uint32_t> poolIndex;	// type, kind, strategy
+	uint32_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	uint32_t deviceAllocations = 0;	// live vkAllocateMemory calls
+
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+	void freeDeviceMemory(VkDeviceMemory memory, bool mapped);
+	uint32_t poolFor(uint32_t memoryType, ResourceKind kind, AllocationStrategy strategy);
+	MemoryBlock* addBlock(uint32_t pool);
+	bool allocateBuddy(MemoryBlock* B, VkDeviceSize size, VkDeviceSize alignment, Allocation& A);
+	void freeBuddy(MemoryBlock* B, VkDeviceSize offset, uint32_t order);
+	bool allocateLinear(MemoryBlock* B, VkDeviceSize size, VkDeviceSize alignment, Allocation& A);
+	void addStats(const MemoryBlock* B, MemoryStats& S) const;
+	static uint32_t orderOf(VkDeviceSize size) {
+		uint32_t order = minOrder;
+		while (((VkDeviceSize)1 << order) < size) {
+			order++;
+		}
+		return order;
+	}
+};
+
+inline void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice dev, VkDeviceSize blockSize) {
+	device = dev;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	granularity = properties.limits.bufferImageGranularity;
+	nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+	maxAllocations = properties.limits.maxMemoryAllocationCount;
+	// buddy blocks must be a power of two
+	defaultBlockSize = (VkDeviceSize)1 << orderOf(blockSize);
+}
+
+inline uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) &&
+			(memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+inline VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate device memory (" + std::to_string(size) + " B)!");
+	}
+	deviceAllocations++;
+	*mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped);
+		if (result != VK_SUCCESS) {
+			vkFreeMemory(device, memory, nullptr);
+			deviceAllocations--;
+			throw std::runtime_error("failed to map device memory!");
+		}
+	}
+	return memory;
+}
+
+inline void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, bool mapped) {
+	if (mapped) {
+		vkUnmapMemory(device, memory);
+	}
+	vkFreeMemory(device, memory, nullptr);
+	deviceAllocations--;
+}
+
+inline uint32_t MemoryAllocator::poolFor(uint32_t memoryType, ResourceKind kind, AllocationStrategy strategy) {
+	// with a granularity of 1 there is nothing to keep apart
+	int kindKey = granularity > 1 ? (int)kind : 0;
+	auto key = std::make_tuple(memoryType, kindKey, (int)strategy);
+	auto it = poolIndex.find(key);
+	if (it != poolIndex.end()) {
+		return it->second;
+	}
+	Pool P;
+	P.memoryType = memoryType;
+	P.kind = (ResourceKind)kindKey;
+	P.strategy = strategy;
+	// at most an eighth of the heap per block, so that small heaps (e.g. host-visible
+	// device-local memory) are not taken by one block
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	P.blockSize = defaultBlockSize;
+	while (P.blockSize > ((VkDeviceSize)1 << (minOrder + 4)) && P.blockSize > heapSize / 8) {
+		P.blockSize /= 2;
+	}
+	pools.push_back(P);
+	poolIndex[key] = (uint32_t)pools.size() - 1;
+	return (uint32_t)pools.size() - 1;
+}
+
+inline MemoryBlock* MemoryAllocator::addBlock(uint32_t pool) {
+	Pool& P = pools[pool];
+	MemoryBlock* B = new MemoryBlock();
+	try {
+		B->memory = allocateDeviceMemory(P.blockSize, P.memoryType, &B->mapped);
+	}
+	catch (...) {
+		delete B;
+		throw;
+	}
+	B->size = P.blockSize;
+	B->strategy = P.strategy;
+	B->pool = pool;
+	if (P.strategy == STRATEGY_BUDDY) {
+		uint32_t top = orderOf(P.blockSize);
+		B->freeRanges.resize(top - minOrder + 1);
+		B->freeRanges[top - minOrder].insert(0);
+	}
+	P.blocks.push_back(B);
+	return B;
+}
+
+inline bool MemoryAllocator::allocateBuddy(MemoryBlock* B, VkDeviceSize size, VkDeviceSize alignment, Allocation& A) {
+	// ranges of 2^order bytes start at multiples of 2^order: rounding up to the alignment aligns them
+	uint32_t order = orderOf(std::max(size, alignment));
+	uint32_t found = order;
+	while (found - minOrder < B->freeRanges.size() && B->freeRanges[found - minOrder].empty()) {
+		found++;
+	}
+	if (found - minOrder >= B->freeRanges.size()) {
+		return false;
+	}
+	VkDeviceSize offset = *B->freeRanges[found - minOrder].begin();
+	B->freeRanges[found - minOrder].erase(B->freeRanges[found - minOrder].begin());
+	// split down, keeping the lower half and freeing the upper one
+	while (found > order) {
+		found--;
+		B->freeRanges[found - minOrder].insert(offset + ((VkDeviceSize)1 << found));
+	}
+	A.offset = offset;
+	A.order = order;
+	B->reserved += (VkDeviceSize)1 << order;
+	return true;
+}
+
+inline void MemoryAllocator::freeBuddy(MemoryBlock* B, VkDeviceSize offset, uint32_t order) {
+	B->reserved -= (VkDeviceSize)1 << order;
+	while (order - minOrder + 1 < B->freeRanges.size()) {
+		VkDeviceSize buddy = offset ^ ((VkDeviceSize)1 << order);
+		auto& ranges = B->freeRanges[order - minOrder];
+		auto it = ranges.find(buddy);
+		if (it == ranges.end()) {
+			break;
+		}
+		ranges.erase(it);
+		offset = std::min(offset, buddy);
+		order++;
+	}
+	B->freeRanges[order - minOrder].insert(offset);
+}
+
+inline bool MemoryAllocator::allocateLinear(MemoryBlock* B, VkDeviceSize size, VkDeviceSize alignment, Allocation& A) {
+	VkDeviceSize offset = (B->top + alignment - 1) / alignment * alignment;
+	if (offset + size > B->size) {
+		return false;
+	}
+	A.offset = offset;
+	B->reserved += offset + size - B->top;
+	B->top = offset + size;
+	return true;
+}
+
+inline Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+	ResourceKind kind, AllocationStrategy strategy) {
+	std::lock_guard<std::mutex> lock(mtx);
+	uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+	uint32_t pool = poolFor(memoryType, kind, strategy);
+	Pool& P = pools[pool];
+
+	Allocation A;
+	A.size = requirements.size;
+	A.memoryType = memoryType;
+	VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+	if (requirements.size > P.blockSize / 2) {
+		A.memory = allocateDeviceMemory(requirements.size, memoryType, &A.mapped);
+		dedicatedCount++;
+		dedicatedBytes += requirements.size;
+		return A;
+	}
+
+	MemoryBlock* target = nullptr;
+	for (MemoryBlock* B : P.blocks) {
+		bool fits = strategy == STRATEGY_BUDDY ?
+			allocateBuddy(B, requirements.size, alignment, A) : allocateLinear(B, requirements.size, alignment, A);
+		if (fits) {
+			target = B;
+			break;
+		}
+	}
+	if (target == nullptr) {
+		target = addBlock(pool);
+		bool fits = strategy == STRATEGY_BUDDY ?
+			allocateBuddy(target, requirements.size, alignment, A) : allocateLinear(target, requirements.size, alignment, A);
+		if (!fits) {
+			throw std::runtime_error("failed to sub-allocate device memory!");
+		}
+	}
+	target->live++;
+	target->used += requirements.size;
+	A.block = target;
+	A.memory = target->memory;
+	A.mapped = target->mapped ? (char*)target->mapped + A.offset : nullptr;
+	return A;
+}
+
+inline void MemoryAllocator::free(Allocation& A) {
+	if (A.memory == VK_NULL_HANDLE) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mtx);
+	MemoryBlock* B = A.block;
+	if (B == nullptr) {
+		freeDeviceMemory(A.memory, A.mapped != nullptr);
+		dedicatedCount--;
+		dedicatedBytes -= A.size;
+		A = Allocation();
+		return;
+	}
+
+	B->live--;
+	B->used -= A.size;
+	if (B->strategy == STRATEGY_BUDDY) {
+		freeBuddy(B, A.offset, A.order);
+	}
+	else if (B->live == 0) {
+		B->top = 0;
+		B->reserved = 0;
+	}
+	A = Allocation();
+
+	// an empty block goes back to the driver, unless it is the last one of its pool
+	Pool& P = pools[B->pool];
+	if (B->live == 0 && P.blocks.size() > 1) {
+		P.blocks.erase(std::find(P.blocks.begin(), P.blocks.end(), B));
+		freeDeviceMemory(B->memory, B->mapped != nullptr);
+		delete B;
+	}
+}
+
+inline bool MemoryAllocator::isCoherent(const Allocation& A) const {
+	return (memoryProperties.memoryTypes[A.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+inline void MemoryAllocator::flush(const Allocation& A, VkDeviceSize offset, VkDeviceSize size) const {
+	if (A.memory == VK_NULL_HANDLE || size == 0 || isCoherent(A)) {
+		return;
+	}
+	// the range is widened to whole atoms, without going past the end of the memory object
+	VkDeviceSize memorySize = A.block ? A.block->size : A.size;
+	VkDeviceSize begin = (A.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+	VkDeviceSize end = std::min((A.offset + offset + size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize, memorySize);
+	VkMappedMemoryRange range{};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = A.memory;
+	range.offset = begin;
+	range.size = end - begin;
+	if (vkFlushMappedMemoryRanges(device, 1, &range) != VK_SUCCESS) {
+		throw std::runtime_error("failed to flush mapped memory!");
+	}
+}
+
+inline void MemoryAllocator::cleanup() {
+	std::lock_guard<std::mutex> lock(mtx);
+	for (Pool& P : pools) {
+		for (MemoryBlock* B : P.blocks) {
+			if (B->live > 0) {
+				std::cout << "Memory block of type " << P.memoryType << " freed with " << B->live << " live allocations\n";
+			}
+			freeDeviceMemory(B->memory, B->mapped != nullptr);
+			delete B;
+		}
+	}
+	pools.clear();
+	poolIndex.clear();
+}
+
+inline void MemoryAllocator::addStats(const MemoryBlock* B, MemoryStats& S) const {
+	S.blocks++;
+	S.allocations += B->live;
+	S.blockBytes += B->size;
+	S.usedBytes += B->used;
+	S.reservedBytes += B->reserved;
+	S.freeBytes += B->size - B->reserved;
+	if (B->strategy == STRATEGY_BUDDY) {
+		for (size_t i = B->freeRanges.size(); i-- > 0; ) {
+			if (!B->freeRanges[i].empty()) {
+				S.largestFree = std::max(S.largestFree, (VkDeviceSize)1 << (i + minOrder));
+				break;
+			}
+		}
+	}
+	else {
+		S.largestFree = std::max(S.largestFree, B->size - B->top);
+	}
+}
+
+inline MemoryStats MemoryAllocator::stats() const {
+	std::lock_guard<std::mutex> lock(mtx);
+	MemoryStats S;
+	for (const Pool& P : pools) {
+		for (const MemoryBlock* B : P.blocks) {
+			addStats(B, S);
+		}
+	}
+	S.dedicated = dedicatedCount;
+	S.dedicatedBytes = dedicatedBytes;
+	S.allocations += dedicatedCount;
+	return S;
+}
+
+inline void MemoryAllocator::printStats(std::ostream& out) const {
+	std::lock_guard<std::mutex> lock(mtx);
+	MemoryStats total;
+	for (const Pool& P : pools) {
+		MemoryStats S;
+		for (const MemoryBlock* B : P.blocks) {
+			addStats(B, S);
+		}
+		total.blocks += S.blocks;
+		total.allocations += S.allocations;
+		total.blockBytes += S.blockBytes;
+		total.usedBytes += S.usedBytes;
+		total.reservedBytes += S.reservedBytes;
+		total.freeBytes += S.freeBytes;
+		total.largestFree = std::max(total.largestFree, S.largestFree);
+		out << "  type " << P.memoryType << (P.strategy == STRATEGY_BUDDY ? " buddy" : " linear")
+			<< (P.kind == RESOURCE_OPTIMAL ? " images" : "") << ": " << S.blocks << " x "
+			<< P.blockSize / 1024 << " KB, " << S.allocations << " allocations, "
+			<< S.usedBytes / 1024 << " KB used (" << S.reservedBytes / 1024 << " KB reserved), "
+			<< S.freeBytes / 1024 << " KB free, fragmentation " << S.fragmentation() << "\n";
+	}
+	out << "  " << dedicatedCount << " dedicated allocations, " << dedicatedBytes / 1024 << " KB\n";
+	out << "  total: " << total.allocations + dedicatedCount << " resources in " << deviceAllocations
+		<< " device allocations (limit " << maxAllocations << "), "
+		<< total.usedBytes / 1024 << " KB used in " << total.blockBytes / 1024 << " KB of blocks, fragmentation "
+		<< total.fragmentation() << "\n";
+}
@@ -0,0 +1,575 @@
+#pragma once
+// Triangle and vertex reordering for indexed triangle lists, run by Model::load before the
+// mesh is cached and uploaded:
+// - optimizeVertexCache: Tipsify (Sander, Nehab, Barczak 2007), fans triangles around recently
+//   used vertices so that the post-transform cache hits more often;
+// - optimizeOverdraw: splits that order into clusters of good cache locality and sorts them so
+//   that outward-facing clusters, far from the mesh center, are drawn first; they tend to occlude
+//   the rest from most viewpoints, and the early depth test then rejects more fragments;
+// - optimizeVertexFetch: renumbers vertices in order of first use, so that vertex fetches walk
+//   the buffer mostly forward, and drops unreferenced vertices.
+// analyzeVertexCache measures the result on a FIFO cache:
+// ACMR (transformed vertices per triangle, 0.5 at best) and ATVR (per vertex, 1.0 at best).
+// simplify builds the lower levels of detail, by quadric error edge collapses (Garland, Heckbert
+// 1997) that only reuse existing vertices, so that every level shares one vertex buffer.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace MeshOptimizer {
+
+struct CacheStats {
+	float acmr;
+	float atvr;
+};
+
+inline CacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16) {
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	for (uint32_t v : indices) {
+		if (time - timestamps[v] > cacheSize) {
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+	size_t used = 0;
+	for (uint32_t t : timestamps) {
+		used += t != 0;
+	}
+	CacheStats S;
+	S.acmr = indices.size() < 3 ? 0.0f : (float)misses / (indices.size() / 3);
+	S.atvr = used == 0 ? 0.0f : (float)misses / used;
+	return S;
+}
+
+// Triangles adjacent to each vertex, in compressed rows
+struct Adjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+
+	Adjacency(const std::vector<uint32_t>& indices, size_t vertexCount) : offsets(vertexCount + 1, 0) {
+		for (uint32_t v : indices) {
+			offsets[v + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(indices.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) {
+			triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+		}
+	}
+};
+
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16) {
+	size_t triangleCount = indices.size() / 3;
+	Adjacency A(indices, vertexCount);
+
+	std::vector<uint32_t> live(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		live[v] = A.offsets[v + 1] - A.offsets[v];
+	}
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	uint32_t time = cacheSize + 1;
+	size_t cursor = 0;
+	int64_t fan = vertexCount > 0 ? 0 : -1;
+
+	while (fan >= 0) {
+		candidates.clear();
+		for (uint32_t a = A.offsets[fan]; a < A.offsets[fan + 1]; a++) {
+			uint32_t t = A.triangles[a];
+			if (emitted[t]) {
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[3 * t + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - timestamps[v] > cacheSize) {
+					timestamps[v] = time++;
+				}
+			}
+			emitted[t] = 1;
+		}
+
+		// Next fanning vertex: the candidate that will still be in the cache after its remaining
+		// triangles are emitted, and among those the one that entered the cache earliest
+		int64_t next = -1;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - timestamps[v] + 2 * live[v] <= cacheSize) {
+				priority = time - timestamps[v];
+			}
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		// Dead end: back to the most recent vertex with triangles left, or to the next one in order
+		while (next < 0 && !deadEnd.empty()) {
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0) {
+				next = v;
+			}
+		}
+		while (next < 0 && cursor < vertexCount) {
+			if (live[cursor] > 0) {
+				next = cursor;
+			}
+			cursor++;
+		}
+		fan = next;
+	}
+	indices.swap(result);
+}
+
+// Reorders clusters of triangles, keeping the order inside each one (run it on the output of
+// optimizeVertexCache). positions holds vertexCount xyz triplets. threshold is the ACMR increase
+// accepted in exchange for smaller, more sortable clusters.
+inline void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& positions,
+	size_t vertexCount, uint32_t cacheSize = 16, float threshold = 1.05f) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Hard boundaries: triangles whose three vertices all miss the cache, i.e. where the
+	// vertex cache optimizer jumped to a new region
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	std::vector<uint32_t> misses(triangleCount);
+	uint32_t time = cacheSize + 1;
+	for (size_t t = 0; t < triangleCount; t++) {
+		misses[t] = 0;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = indices[3 * t + k];
+			if (time - timestamps[v] > cacheSize) {
+				timestamps[v] = time++;
+				misses[t]++;
+			}
+		}
+	}
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (t == 0 || misses[t] == 3) {
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triangleCount);
+
+	// Soft boundaries: inside each hard cluster, cut wherever the running ACMR gets within
+	// threshold of the ACMR of the whole cluster
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++) {
+		size_t start = hard[h], end = hard[h + 1];
+		size_t total = 0;
+		for (size_t t = start; t < end; t++) {
+			total += misses[t];
+		}
+		float clusterAcmr = (float)total / (end - start);
+		clusters.push_back(start);
+		size_t running = 0;
+		for (size_t t = start; t < end; t++) {
+			running += misses[t];
+			if (t + 1 < end && (float)running / (t - start + 1) <= clusterAcmr * threshold &&
+				t + 1 - clusters.back() >= 4) {
+				clusters.push_back(t + 1);
+				running = 0;
+				start = t + 1;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	auto position = [&](uint32_t v, int c) { return positions[3 * (size_t)v + c]; };
+	float meshCenter[3] = {};
+	for (size_t v = 0; v < vertexCount; v++) {
+		for (int c = 0; c < 3; c++) {
+			meshCenter[c] += position((uint32_t)v, c) / vertexCount;
+		}
+	}
+
+	// Sort key: how far the cluster lies out along its own average normal
+	size_t clusterCount = clusters.size() - 1;
+	std::vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		float center[3] = {}, normal[3] = {}, area = 0;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			float p[3][3];
+			for (int k = 0; k < 3; k++) {
+				for (int j = 0; j < 3; j++) {
+					p[k][j] = position(indices[3 * t + k], j);
+				}
+			}
+			float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+			float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float a = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int j = 0; j < 3; j++) {
+				center[j] += (p[0][j] + p[1][j] + p[2][j]) / 3.0f * a;
+				normal[j] += n[j];
+			}
+			area += a;
+		}
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (area <= 0 || length <= 0) {
+			sortKey[c] = 0;
+			continue;
+		}
+		float dot = 0;
+		for (int j = 0; j < 3; j++) {
+			dot += (center[j] / area - meshCenter[j]) * normal[j] / length;
+		}
+		sortKey[c] = dot;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t c : order) {
+		result.insert(result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+	}
+	indices.swap(result);
+}
+
+// Renumbers the vertices of an interleaved buffer in order of first use; returns the new vertex count
+inline size_t optimizeVertexFetch(std::vector<unsigned char>& vertices, size_t stride, std::vector<uint32_t>& indices) {
+	size_t vertexCount = vertices.size() / stride;
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	std::vector<unsigned char> result;
+	result.reserve(vertices.size());
+	uint32_t next = 0;
+	for (uint32_t& v : indices) {
+		if (remap[v] == UINT32_MAX) {
+			remap[v] = next++;
+			result.insert(result.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+		}
+		v = remap[v];
+	}
+	vertices.swap(result);
+	return next;
+}
+
+// Symmetric 4x4 matrix accumulating squared distances from a set of planes, weighted by area
+struct Quadric {
+	double m[10] = {};	// upper triangle, row by row
+	double weight = 0;
+
+	void addPlane(double a, double b, double c, double d, double w) {
+		double p[4] = { a, b, c, d };
+		int k = 0;
+		for (int i = 0; i < 4; i++) {
+			for (int j = i; j < 4; j++) {
+				m[k++] += w * p[i] * p[j];
+			}
+		}
+		weight += w;
+	}
+
+	void add(const Quadric& o) {
+		for (int k = 0; k < 10; k++) {
+			m[k] += o.m[k];
+		}
+		weight += o.weight;
+	}
+
+	// Mean squared distance of p from the planes
+	double error(const float* p) const {
+		double v[4] = { p[0], p[1], p[2], 1.0 };
+		double e = 0;
+		int k = 0;
+		for (int i = 0; i < 4; i++) {
+			for (int j = i; j < 4; j++) {
+				e += (i == j ? 1 : 2) * m[k++] * v[i] * v[j];
+			}
+		}
+		return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+	}
+};
+
+// Returns an index buffer with at most targetIndexCount indices, when reachable, made of the same
+// vertices. Vertices sharing a position (split by normals or UVs) move together; when a corner
+// moves to a new position it takes the vertex there whose attributes (attributeStride floats per
+// vertex, may be empty) are closest to its own. Open borders and non-manifold edges stay in place.
+// error receives an estimate of the largest distance between the two surfaces.
+inline std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const std::vector<float>& positions,
+	size_t vertexCount, const std::vector<float>& attributes, size_t attributeStride,
+	size_t targetIndexCount, float& error) {
+	error = 0;
+
+	// Weld by position
+	std::vector<uint32_t> posOf(vertexCount);
+	std::vector<uint32_t> firstVertex;
+	{
+		struct Key {
+			uint32_t v[3];
+			bool operator==(const Key& o) const { return memcmp(v, o.v, sizeof(v)) == 0; }
+		};
+		struct KeyHash {
+			size_t operator()(const Key& k) const { return (k.v[0] * 73856093u) ^ (k.v[1] * 19349663u) ^ (k.v[2] * 83492791u); }
+		};
+		std::unordered_map<Key, uint32_t, KeyHash> ids;
+		for (size_t v = 0; v < vertexCount; v++) {
+			Key k;
+			memcpy(k.v, &positions[3 * v], sizeof(k.v));
+			auto it = ids.emplace(k, (uint32_t)firstVertex.size());
+			if (it.second) {
+				firstVertex.push_back((uint32_t)v);
+			}
+			posOf[v] = it.first->second;
+		}
+	}
+	size_t posCount = firstVertex.size();
+	auto P = [&](uint32_t p) { return &positions[3 * (size_t)firstVertex[p]]; };
+
+	std::vector<uint32_t> tris;
+	tris.reserve(indices.size());
+	for (uint32_t i : indices) {
+		tris.push_back(posOf[i]);
+	}
+
+	std::vector<Quadric> quadrics(posCount);
+	for (size_t t = 0; t < tris.size(); t += 3) {
+		const float* a = P(tris[t]);
+		const float* b = P(tris[t + 1]);
+		const float* c = P(tris[t + 2]);
+		double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0) {
+			continue;
+		}
+		for (int j = 0; j < 3; j++) {
+			n[j] /= length;
+		}
+		double d = -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]);
+		for (int k = 0; k < 3; k++) {
+			quadrics[tris[t + k]].addPlane(n[0], n[1], n[2], d, length * 0.5);
+		}
+	}
+
+	// Edges used by one triangle (borders) or by more than two (non-manifold) lock their ends
+	std::vector<char> locked(posCount, 0);
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = tris[t + k], b = tris[t + (k + 1) % 3];
+				edgeUse[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+			}
+		}
+		for (const auto& e : edgeUse) {
+			if (e.second != 2) {
+				locked[e.first >> 32] = 1;
+				locked[e.first & 0xFFFFFFFFu] = 1;
+			}
+		}
+	}
+
+	std::vector<uint32_t> remap(posCount);
+	for (size_t p = 0; p < posCount; p++) {
+		remap[p] = (uint32_t)p;
+	}
+	auto normal = [&](uint32_t a, uint32_t b, uint32_t c, double* n) {
+		const float* pa = P(a);
+		const float* pb = P(b);
+		const float* pc = P(c);
+		double e1[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+		double e2[3] = { pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	};
+
+	struct Collapse {
+		uint32_t from, to;
+		double cost;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<char> touched(posCount);
+	std::vector<uint32_t> adjacencyOffsets, adjacency;
+	double maxError = 0;
+
+	// Each pass collapses the cheapest edges whose neighborhoods do not overlap
+	while (tris.size() > targetIndexCount) {
+		adjacencyOffsets.assign(posCount + 1, 0);
+		for (uint32_t p : tris) {
+			adjacencyOffsets[p + 1]++;
+		}
+		for (size_t p = 0; p < posCount; p++) {
+			adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+		}
+		adjacency.resize(tris.size());
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < tris.size(); i++) {
+			adjacency[fill[tris[i]]++] = (uint32_t)(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = tris[t + k], b = tris[t + (k + 1) % 3];
+				if (a > b || locked[a] || locked[b]) {
+					continue;	// each interior edge is seen from both of its triangles
+				}
+				Quadric q = quadrics[a];
+				q.add(quadrics[b]);
+				double toB = q.error(P(b)), toA = q.error(P(a));
+				collapses.push_back(toB <= toA ? Collapse{ a, b, toB } : Collapse{ b, a, toA });
+			}
+		}
+		if (collapses.empty()) {
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t triangleCount = tris.size() / 3;
+		size_t target = targetIndexCount / 3;
+		size_t done = 0;
+		for (const Collapse& c : collapses) {
+			if (triangleCount <= target) {
+				break;
+			}
+			if (touched[c.from] || touched[c.to]) {
+				continue;
+			}
+
+			// Reject collapses that flip or squash a triangle around the vertex that moves
+			bool valid = true;
+			size_t removed = 0;
+			for (uint32_t a = adjacencyOffsets[c.from]; a < adjacencyOffsets[c.from + 1] && valid; a++) {
+				const uint32_t* t = &tris[3 * adjacency[a]];
+				if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+					removed++;
+					continue;
+				}
+				uint32_t moved[3] = { t[0], t[1], t[2] };
+				for (int k = 0; k < 3; k++) {
+					if (moved[k] == c.from) {
+						moved[k] = c.to;
+					}
+				}
+				double before[3], after[3];
+				normal(t[0], t[1], t[2], before);
+				normal(moved[0], moved[1], moved[2], after);
+				double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				double lb = std::sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+				double la = std::sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+				valid = la > 0 && dot > 0.25 * lb * la;
+			}
+			if (!valid) {
+				continue;
+			}
+
+			remap[c.from] = c.to;
+			quadrics[c.to].add(quadrics[c.from]);
+			for (uint32_t a = adjacencyOffsets[c.from]; a < adjacencyOffsets[c.from + 1]; a++) {
+				for (int k = 0; k < 3; k++) {
+					touched[tris[3 * adjacency[a] + k]] = 1;
+				}
+			}
+			maxError = std::max(maxError, c.cost);
+			triangleCount -= removed;
+			done++;
+		}
+		if (done == 0) {
+			break;
+		}
+
+		// Apply the pass: move the collapsed corners and drop the degenerate triangles
+		size_t out = 0;
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			uint32_t a = remap[tris[t]], b = remap[tris[t + 1]], c = remap[tris[t + 2]];
+			if (a != b && b != c && a != c) {
+				tris[out++] = a;
+				tris[out++] = b;
+				tris[out++] = c;
+			}
+		}
+		tris.resize(out);
+	}
+	error = (float)std::sqrt(maxError);
+
+	// Back to vertices: positions that moved take the closest matching vertex at the destination
+	std::vector<uint32_t> wedgeOffsets(posCount + 1, 0), wedges(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		wedgeOffsets[posOf[v] + 1]++;
+	}
+	for (size_t p = 0; p < posCount; p++) {
+		wedgeOffsets[p + 1] += wedgeOffsets[p];
+	}
+	{
+		std::vector<uint32_t> fill(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+		for (size_t v = 0; v < vertexCount; v++) {
+			wedges[fill[posOf[v]]++] = (uint32_t)v;
+		}
+	}
+	auto resolve = [&](uint32_t p) {
+		while (remap[p] != p) {
+			p = remap[p];
+		}
+		return p;
+	};
+
+	std::vector<uint32_t> result;
+	result.reserve(tris.size());
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		uint32_t p[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = resolve(posOf[indices[t + k]]);
+		}
+		if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = indices[t + k];
+			if (posOf[v] != p[k]) {
+				uint32_t best = wedges[wedgeOffsets[p[k]]];
+				float bestDistance = std::numeric_limits<float>::max();
+				for (uint32_t w = wedgeOffsets[p[k]]; w < wedgeOffsets[p[k] + 1] && attributeStride > 0; w++) {
+					float distance = 0;
+					for (size_t j = 0; j < attributeStride; j++) {
+						float d = attributes[wedges[w] * attributeStride + j] - attributes[v * attributeStride + j];
+						distance += d * d;
+					}
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = wedges[w];
+					}
+				}
+				v = best;
+			}
+			result.push_back(v);
+		}
+	}
+	return result;
+}
+
+}
@@ -0,0 +1,444 @@
+#pragma once
+// Streaming Wavefront OBJ reader used by Model::loadModelOBJ.
+// It works on an in-memory (usually mmapped) copy of the file: a quick line scan counts the
+// elements so that every output buffer is sized once, then a single parsing pass reads the
+// attributes and faces, writes each corner straight into the interleaved vertex layout of the
+// caller and welds identical corners. No heap allocation happens per vertex or per line.
+// Floats are parsed with SWAR (SIMD within a register) arithmetic that classifies and converts
+// up to eight digits at a time, falling back to strtod only when the fast path cannot round exactly.
+
+#include <cstdint>
+#include <cstdlib>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Where each attribute goes inside one interleaved vertex; -1 when the layout does not have it
+struct ObjVertexLayout {
+	uint32_t stride;
+	int positionOffset;
+	int normalOffset;
+	int uvOffset;
+	int colorOffset;
+};
+
+namespace ObjParser {
+
+inline bool isDigit(char c) {
+	return (unsigned char)(c - '0') < 10;
+}
+
+inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline int countTrailingZeros(uint64_t v) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return (int)index;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+// Loads eight characters as a little-endian word, the first character in the lowest byte
+inline uint64_t loadEight(const char* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+// Converts a word of eight ASCII digits to its value, with three multiplications
+inline uint64_t convertEightDigits(uint64_t v) {
+	v -= 0x3030303030303030ull;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+		(((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+	return v;
+}
+
+// Accumulates a run of digits into the mantissa, keeping at most 19 significant digits.
+// Up to eight digits are classified and converted at once: the length of the run is found
+// from a per-byte "is not a digit" mask, and shorter runs are left-padded with '0' characters.
+// Returns the number of digits consumed; dropped (non significant) digits are counted apart.
+inline int parseDigits(const char*& p, const char* end, uint64_t& mantissa, int& significant, int& dropped) {
+	static const uint64_t pow10[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull };
+	const char* start = p;
+	while (end - p >= 8 && significant <= 11) {
+		uint64_t v = loadEight(p);
+		uint64_t x = v ^ 0x3030303030303030ull;
+		uint64_t nonDigit = (((x & 0x7F7F7F7F7F7F7F7Full) + 0x7676767676767676ull) | x) & 0x8080808080808080ull;
+		int n = nonDigit ? countTrailingZeros(nonDigit) / 8 : 8;
+		if (n == 0) {
+			return (int)(p - start);
+		}
+		if (n < 8) {
+			v = (v << (8 * (8 - n))) | (0x3030303030303030ull >> (8 * n));
+		}
+		mantissa = mantissa * pow10[n] + convertEightDigits(v);
+		significant = mantissa == 0 ? 0 : significant + n;
+		p += n;
+		if (n < 8) {
+			return (int)(p - start);
+		}
+	}
+	while (p < end && isDigit(*p)) {
+		if (significant < 19) {
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			significant = mantissa == 0 ? 0 : significant + 1;
+		}
+		else {
+			dropped++;
+		}
+		p++;
+	}
+	return (int)(p - start);
+}
+
+inline bool parseFloat(const char*& p, const char* end, float& out) {
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int significant = 0;
+	int exponent = 0;
+	int dropped = 0;
+	int digits = parseDigits(p, end, mantissa, significant, dropped);
+	exponent += dropped;
+	if (p < end && *p == '.') {
+		p++;
+		dropped = 0;
+		int fraction = parseDigits(p, end, mantissa, significant, dropped);
+		exponent -= fraction - dropped;
+		digits += fraction;
+	}
+	if (digits == 0) {
+		p = start;
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* e = p + 1;
+		bool negativeExp = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			negativeExp = *e == '-';
+			e++;
+		}
+		if (e < end && isDigit(*e)) {
+			int value = 0;
+			while (e < end && isDigit(*e)) {
+				if (value < 10000) {
+					value = value * 10 + (*e - '0');
+				}
+				e++;
+			}
+			exponent += negativeExp ? -value : value;
+			p = e;
+		}
+	}
+
+	double d;
+	if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		// both operands are exact, so a single IEEE operation rounds correctly
+		d = (double)mantissa;
+		d = exponent < 0 ? d / pow10[-exponent] : d * pow10[exponent];
+		if (negative) {
+			d = -d;
+		}
+	}
+	else {
+		char buf[64];
+		size_t len = (size_t)(p - start) < sizeof(buf) - 1 ? (size_t)(p - start) : sizeof(buf) - 1;
+		memcpy(buf, start, len);
+		buf[len] = 0;
+		d = strtod(buf, nullptr);
+	}
+	out = (float)d;
+	return true;
+}
+
+inline bool parseInt(const char*& p, const char* end, long& out) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= end || !isDigit(*p)) {
+		return false;
+	}
+	long value = 0;
+	while (p < end && isDigit(*p)) {
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	out = negative ? -value : value;
+	return true;
+}
+
+inline void skipBlanks(const char*& p, const char* end) {
+	while (p < end && isBlank(*p)) {
+		p++;
+	}
+}
+
+inline const char* lineEnd(const char* p, const char* end) {
+	const char* nl = (const char*)memchr(p, '\n', end - p);
+	return nl ? nl : end;
+}
+
+// OBJ indices are 1-based, negative values are relative to the end of the list read so far
+inline uint32_t resolveIndex(long idx, size_t count) {
+	long resolved = idx > 0 ? idx - 1 : (long)count + idx;
+	if (idx == 0 || resolved < 0 || (size_t)resolved >= count) {
+		throw std::runtime_error("OBJ: face index out of range");
+	}
+	return (uint32_t)resolved;
+}
+
+inline uint64_t hashVertex(const unsigned char* v, uint32_t stride) {
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ stride;
+	uint32_t i = 0;
+	for (; i + 8 <= stride; i += 8) {
+		uint64_t w;
+		memcpy(&w, v + i, sizeof(w));
+		h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+	}
+	for (; i < stride; i++) {
+		h = (h ^ v[i]) * 0x100000001B3ull;
+	}
+	return h ^ (h >> 29);
+}
+
+inline float distance2(const std::vector<float>& positions, uint32_t a, uint32_t b) {
+	float d2 = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		float d = positions[(size_t)b * 3 + i] - positions[(size_t)a * 3 + i];
+		d2 += d * d;
+	}
+	return d2;
+}
+
+struct FaceCorner {
+	uint32_t v, vt, vn;
+	bool hasVt, hasVn;
+};
+
+// Parses an OBJ file held in memory into an interleaved, welded vertex buffer and a triangle
+// list. Polygons are triangulated as fans. Returns the number of triangle corners read, i.e.
+// the vertex count before welding.
+inline size_t parse(const char* data, size_t size, const ObjVertexLayout& L,
+	std::vector<unsigned char>& vertices, std::vector<uint32_t>& indices) {
+	const char* end = data + size;
+
+	// Counting scan: only looks at the first characters of each line, plus the tokens of faces
+	size_t nPos = 0, nUV = 0, nNorm = 0, corners = 0;
+	for (const char* p = data; p < end; ) {
+		const char* e = lineEnd(p, end);
+		skipBlanks(p, e);
+		if (e - p >= 2 && p[0] == 'v') {
+			if (isBlank(p[1])) nPos++;
+			else if (p[1] == 't') nUV++;
+			else if (p[1] == 'n') nNorm++;
+		}
+		else if (e - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+			size_t tokens = 0;
+			for (const char* q = p + 1; q < e; ) {
+				skipBlanks(q, e);
+				if (q >= e) break;
+				tokens++;
+				while (q < e && !isBlank(*q)) q++;
+			}
+			if (tokens >= 3) corners += 3 * (tokens - 2);
+		}
+		p = e + 1;
+	}
+
+	std::vector<float> positions;
+	std::vector<float> colors;
+	std::vector<float> uvs;
+	std::vector<float> normals;
+	positions.reserve(nPos * 3);
+	if (L.colorOffset >= 0) colors.reserve(nPos * 3);
+	uvs.reserve(nUV * 2);
+	normals.reserve(nNorm * 3);
+
+	const uint32_t stride = L.stride;
+	const uint32_t EMPTY = 0xFFFFFFFFu;
+	size_t tableSize = 16;
+	while (tableSize < corners * 2) tableSize <<= 1;
+	std::vector<uint32_t> table(tableSize, EMPTY);
+	const size_t mask = tableSize - 1;
+
+	vertices.assign(corners * stride, 0);
+	indices.clear();
+	indices.reserve(corners);
+	uint32_t vertexCount = 0;
+
+	auto emit = [&](const FaceCorner& c) {
+		if ((size_t)vertexCount >= corners) {
+			throw std::runtime_error("OBJ: malformed face");
+		}
+		unsigned char* v = vertices.data() + (size_t)vertexCount * stride;
+		memset(v, 0, stride);
+		if (L.positionOffset >= 0) {
+			memcpy(v + L.positionOffset, &positions[(size_t)c.v * 3], 3 * sizeof(float));
+		}
+		if (L.colorOffset >= 0) {
+			memcpy(v + L.colorOffset, &colors[(size_t)c.v * 3], 3 * sizeof(float));
+		}
+		if (L.uvOffset >= 0 && c.hasVt) {
+			float uv[2] = { uvs[(size_t)c.vt * 2], 1 - uvs[(size_t)c.vt * 2 + 1] };
+			memcpy(v + L.uvOffset, uv, sizeof(uv));
+		}
+		if (L.normalOffset >= 0 && c.hasVn) {
+			memcpy(v + L.normalOffset, &normals[(size_t)c.vn * 3], 3 * sizeof(float));
+		}
+
+		size_t slot = hashVertex(v, stride) & mask;
+		while (table[slot] != EMPTY) {
+			uint32_t other = table[slot];
+			if (memcmp(vertices.data() + (size_t)other * stride, v, stride) == 0) {
+				indices.push_back(other);
+				return;
+			}
+			slot = (slot + 1) & mask;
+		}
+		table[slot] = vertexCount;
+		indices.push_back(vertexCount);
+		vertexCount++;
+	};
+
+	// Parsing pass
+	for (const char* p = data; p < end; ) {
+		const char* e = lineEnd(p, end);
+		skipBlanks(p, e);
+		if (e - p >= 2 && p[0] == 'v' && isBlank(p[1])) {
+			p += 2;
+			float xyz[3];
+			for (int i = 0; i < 3; i++) {
+				skipBlanks(p, e);
+				if (!parseFloat(p, e, xyz[i])) {
+					throw std::runtime_error("OBJ: malformed vertex position");
+				}
+			}
+			positions.insert(positions.end(), xyz, xyz + 3);
+			if (L.colorOffset >= 0) {
+				// optional per-vertex color extension, white when absent
+				float rgb[3] = { 1.0f, 1.0f, 1.0f };
+				for (int i = 0; i < 3; i++) {
+					skipBlanks(p, e);
+					if (!parseFloat(p, e, rgb[i])) {
+						rgb[0] = rgb[1] = rgb[2] = 1.0f;
+						break;
+					}
+				}
+				colors.insert(colors.end(), rgb, rgb + 3);
+			}
+		}
+		else if (e - p >= 3 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+			p += 3;
+			float uv[2] = { 0.0f, 0.0f };
+			for (int i = 0; i < 2; i++) {
+				skipBlanks(p, e);
+				if (!parseFloat(p, e, uv[i]) && i == 0) {
+					throw std::runtime_error("OBJ: malformed texture coordinate");
+				}
+			}
+			uvs.insert(uvs.end(), uv, uv + 2);
+		}
+		else if (e - p >= 3 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+			p += 3;
+			float n[3];
+			for (int i = 0; i < 3; i++) {
+				skipBlanks(p, e);
+				if (!parseFloat(p, e, n[i])) {
+					throw std::runtime_error("OBJ: malformed vertex normal");
+				}
+			}
+			normals.insert(normals.end(), n, n + 3);
+		}
+		else if (e - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+			p += 2;
+			FaceCorner quad[4], prev{};
+			int count = 0;
+			while (true) {
+				skipBlanks(p, e);
+				if (p >= e) break;
+				FaceCorner c{};
+				long idx;
+				if (!parseInt(p, e, idx)) {
+					throw std::runtime_error("OBJ: malformed face");
+				}
+				c.v = resolveIndex(idx, positions.size() / 3);
+				if (p < e && *p == '/') {
+					p++;
+					if (p < e && *p != '/') {
+						if (!parseInt(p, e, idx)) {
+							throw std::runtime_error("OBJ: malformed face");
+						}
+						c.vt = resolveIndex(idx, uvs.size() / 2);
+						c.hasVt = true;
+					}
+					if (p < e && *p == '/') {
+						p++;
+						if (!parseInt(p, e, idx)) {
+							throw std::runtime_error("OBJ: malformed face");
+						}
+						c.vn = resolveIndex(idx, normals.size() / 3);
+						c.hasVn = true;
+					}
+				}
+				if (count < 4) {
+					quad[count] = c;
+				}
+				else {
+					// larger polygons are triangulated as a fan around the first corner
+					if (count == 4) {
+						emit(quad[0]); emit(quad[1]); emit(quad[2]);
+						emit(quad[0]); emit(quad[2]); emit(quad[3]);
+					}
+					emit(quad[0]); emit(prev); emit(c);
+				}
+				prev = c;
+				count++;
+			}
+			if (count == 3) {
+				emit(quad[0]); emit(quad[1]); emit(quad[2]);
+			}
+			else if (count == 4) {
+				// quads are split along their shorter diagonal
+				if (distance2(positions, quad[0].v, quad[2].v) < distance2(positions, quad[1].v, quad[3].v)) {
+					emit(quad[0]); emit(quad[1]); emit(quad[2]);
+					emit(quad[0]); emit(quad[2]); emit(quad[3]);
+				}
+				else {
+					emit(quad[0]); emit(quad[1]); emit(quad[3]);
+					emit(quad[1]); emit(quad[2]); emit(quad[3]);
+				}
+			}
+		}
+		p = e + 1;
+	}
+
+	vertices.resize((size_t)vertexCount * stride);
+	vertices.shrink_to_fit();
+	return corners;
+}
+
+}
@@ -1,15 +1,28 @@
 #pragma once
 // This has been adapted from the Vulkan tutorial
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <set>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #define GLM_FORCE_RADIANS
@@ -21,7 +34,6 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/transform2.hpp>
 #include <chrono>
-#include <tiny_obj_loader.h>
 #include <stb_image.h>
 #include <sinfl.h>
 #include <tiny_gltf.h>
@@ -30,7 +42,19 @@
 #include <GLFW/glfw3.h>
 
 #include <plusaes.hpp>
+#include <ObjParser.hpp>
+#include <Ktx2.hpp>
+#include <AssetPack.hpp>
+#include <AsyncIO.hpp>
+#include <MemoryAllocator.hpp>
+#include <MeshOptimizer.hpp>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 // For compile compatibility issues
@@ -58,6 +82,8 @@ const std::vector<const char*> validationLayers = {
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// optional: a family that can copy but not draw, used for uploads
+	std::optional<uint32_t> transferFamily;
 
 	inline bool isComplete() {
 		return graphicsFamily.has_value() &&
@@ -162,6 +188,423 @@ inline std::vector<char> readFile(const std::string& filename) {
 	return buffer;
 }
 
+// Read-only view of a whole file. It is memory mapped where the platform allows it,
+// otherwise it falls back to reading the file in memory. open() returns false
+// (instead of throwing) when the file cannot be read, since callers use it to probe caches.
+struct MappedFile {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const std::string& filename);
+	void close();
+
+private:
+	std::vector<char> fallback;
+	bool mapped = false;
+};
+
+inline bool MappedFile::open(const std::string& filename) {
+	close();
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	size = (size_t)st.st_size;
+	if (size > 0) {
+		void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED) {
+			::close(fd);
+			size = 0;
+			return false;
+		}
+		data = (const unsigned char*)ptr;
+		mapped = true;
+	}
+	::close(fd);
+	return true;
+#else
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	size = (size_t)file.tellg();
+	fallback.resize(size);
+	file.seekg(0);
+	file.read(fallback.data(), size);
+	data = (const unsigned char*)fallback.data();
+	return true;
+#endif
+}
+
+inline void MappedFile::close() {
+#ifndef _WIN32
+	if (mapped) {
+		munmap((void*)data, size);
+	}
+#endif
+	mapped = false;
+	fallback.clear();
+	fallback.shrink_to_fit();
+	data = nullptr;
+	size = 0;
+}
+
+// The asset pack mapped by mountAssetPack(), shared by every asset loaded afterwards.
+// It is only written before the asset loader starts, so the workers read it without locking;
+// edited, filled by editedSincePacked() as the assets are opened, is locked.
+struct MountedAssetPack {
+	MappedFile file;
+	std::map<std::string, AssetPack::Entry> entries;
+	std::mutex editedMutex;
+	std::map<std::string, bool> edited;
+};
+
+inline MountedAssetPack& mountedAssetPack() {
+	static MountedAssetPack pack;
+	return pack;
+}
+
+// Returns false (and the assets are read from loose files) when the pack is missing or malformed
+inline bool mountAssetPack(const std::string& filename) {
+	MountedAssetPack& P = mountedAssetPack();
+	P.entries.clear();
+	P.edited.clear();
+	if (!P.file.open(filename)) {
+		std::cout << "No asset pack " << filename << ", using loose files\n";
+		return false;
+	}
+	try {
+		AssetPack::parse(P.file.data, P.file.size, [&](const std::string& name, const AssetPack::Entry& E) {
+			P.entries[name] = E;
+		});
+	}
+	catch (const std::exception& e) {
+		std::cout << filename << ": " << e.what() << ", using loose files\n";
+		P.entries.clear();
+		P.file.close();
+		return false;
+	}
+	std::cout << "[PACK] " << filename << ": " << P.entries.size() << " assets, " << P.file.size << " B\n";
+	return true;
+}
+
+// True when the loose file of a packed asset differs in size or contents (hashBytes) from the
+// packed one: it is then read instead, until the pack is cooked again. Checked once per asset,
+// when it is first opened; an asset without a loose file is never edited
+inline bool editedSincePacked(const std::string& name, const AssetPack::Entry& E) {
+	MountedAssetPack& P = mountedAssetPack();
+	{
+		std::lock_guard<std::mutex> lock(P.editedMutex);
+		auto it = P.edited.find(name);
+		if (it != P.edited.end()) {
+			return it->second;
+		}
+	}
+	bool edited = false;
+	std::error_code ec;
+	auto looseSize = std::filesystem::file_size(name, ec);
+	if (!ec) {
+		edited = looseSize != E.size;
+		MappedFile loose;
+		if (!edited && loose.open(name)) {
+			edited = hashBytes(loose.data, loose.size) != E.hash;
+		}
+	}
+	if (edited) {
+		std::cout << "Stale  : packed " << name << ", using the loose file\n";
+	}
+	std::lock_guard<std::mutex> lock(P.editedMutex);
+	P.edited[name] = edited;
+	return edited;
+}
+
+inline bool isPackedAsset(const std::string& name) {
+	const MountedAssetPack& P = mountedAssetPack();
+	std::string key = AssetPack::normalizeName(name);
+	auto it = P.entries.find(key);
+	return it != P.entries.end() && !editedSincePacked(key, it->second);
+}
+
+// Loose files read ahead by BaseProject::prefetchAsset, keyed by normalized name. The first
+// AssetFile::open of a file takes its contents, waiting for the read when it is still running
+struct PrefetchedFile {
+	bool done = false;
+	bool ok = false;
+	std::vector<unsigned char> data;
+};
+
+struct PrefetchTable {
+	std::mutex mtx;
+	std::condition_variable readDone;
+	std::map<std::string, PrefetchedFile> files;
+};
+
+inline PrefetchTable& prefetchTable() {
+	static PrefetchTable table;
+	return table;
+}
+
+// Returns false when the file was not prefetched, or could not be read
+inline bool takePrefetched(const std::string& name, std::vector<unsigned char>& data) {
+	PrefetchTable& T = prefetchTable();
+	std::unique_lock<std::mutex> lock(T.mtx);
+	auto it = T.files.find(AssetPack::normalizeName(name));
+	if (it == T.files.end()) {
+		return false;
+	}
+	T.readDone.wait(lock, [&it] { return it->second.done; });
+	bool ok = it->second.ok;
+	data.swap(it->second.data);
+	T.files.erase(it);
+	return ok;
+}
+
+// Read-only bytes of an asset: a span of the mounted pack when the asset is packed (no copy),
+// otherwise the prefetched contents of the loose file, or the loose file mapped on its own.
+// Like MappedFile, open() returns false when the asset cannot be found.
+struct AssetFile {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	bool packed = false;
+
+	AssetFile() = default;
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+
+	bool open(const std::string& name, bool allowPacked = true);
+	void close();
+	// hashBytes of the contents, precomputed for packed assets
+	uint64_t hash() const;
+
+private:
+	MappedFile loose;
+	std::vector<unsigned char> prefetched;
+	uint64_t packedHash = 0;
+};
+
+inline bool AssetFile::open(const std::string& name, bool allowPacked) {
+	close();
+	if (allowPacked) {
+		const MountedAssetPack& P = mountedAssetPack();
+		std::string key = AssetPack::normalizeName(name);
+		auto it = P.entries.find(key);
+		if (it != P.entries.end() && !editedSincePacked(key, it->second)) {
+			data = P.file.data + it->second.offset;
+			size = (size_t)it->second.size;
+			packedHash = it->second.hash;
+			packed = true;
+			return true;
+		}
+	}
+	if (takePrefetched(name, prefetched)) {
+		data = prefetched.data();
+		size = prefetched.size();
+		return true;
+	}
+	if (!loose.open(name)) {
+		return false;
+	}
+	data = loose.data;
+	size = loose.size;
+	return true;
+}
+
+inline void AssetFile::close() {
+	loose.close();
+	std::vector<unsigned char>().swap(prefetched);
+	data = nullptr;
+	size = 0;
+	packed = false;
+	packedHash = 0;
+}
+
+inline uint64_t AssetFile::hash() const {
+	return packed ? packedHash : hashBytes(data, size);
+}
+
+// Worker pool for the CPU side of asset loading: file reads, image decoding and mesh parsing.
+// Every job may come with a finisher (typically the GPU upload) that has to run on the main
+// thread: finish() is the join point, it waits for the queued jobs and then runs their
+// finishers in submission order. The first exception thrown by a job is rethrown by finish().
+// Jobs belong to load groups (0 unless setGroup() is called), which are joined separately:
+// the assets of a scene can be finished while the other groups are still loading.
+class AssetLoader {
+public:
+	~AssetLoader() { stop(); }
+
+	void start(unsigned threads = 0);
+	// Group of the jobs submitted from now on
+	void setGroup(int group);
+	void submit(std::function<void()> work, std::function<void()> finisher = nullptr);
+	void finish(int group = 0);
+	// True when finish(group) would not block; groups with no jobs are always finished
+	bool ready(int group);
+	bool finished(int group);
+	// Lowest group not finished yet, -1 if none
+	int nextGroup();
+	void stop();
+
+private:
+	struct Group {
+		size_t pendingJobs = 0;
+		std::vector<std::function<void()>> finishers;
+		bool finished = false;
+	};
+
+	std::vector<std::thread> workers;
+	std::deque<std::pair<int, std::function<void()>>> jobs;
+	std::map<int, Group> groups;
+	int currentGroup = 0;
+	std::mutex mtx;
+	std::condition_variable jobReady;
+	std::condition_variable jobsDone;
+	bool quitting = false;
+	std::exception_ptr firstError;
+
+	void workerLoop();
+};
+
+inline void AssetLoader::start(unsigned threads) {
+	if (!workers.empty()) {
+		return;
+	}
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	quitting = false;
+	for (unsigned i = 0; i < threads; i++) {
+		workers.emplace_back(&AssetLoader::workerLoop, this);
+	}
+	std::cout << "Asset loader: " << threads << " threads\n";
+}
+
+inline void AssetLoader::setGroup(int group) {
+	std::unique_lock<std::mutex> lock(mtx);
+	currentGroup = group;
+}
+
+inline void AssetLoader::submit(std::function<void()> work, std::function<void()> finisher) {
+	std::unique_lock<std::mutex> lock(mtx);
+	Group& G = groups[currentGroup];
+	G.finished = false;
+	if (!work || workers.empty()) {
+		// nothing to do in background, or no pool running: behave like a plain synchronous load
+		lock.unlock();
+		if (work) {
+			work();
+		}
+		lock.lock();
+		if (finisher) {
+			G.finishers.push_back(finisher);
+		}
+		return;
+	}
+	if (finisher) {
+		G.finishers.push_back(finisher);
+	}
+	G.pendingJobs++;
+	jobs.push_back({ currentGroup, work });
+	jobReady.notify_one();
+}
+
+inline void AssetLoader::finish(int group) {
+	std::vector<std::function<void()>> toRun;
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		Group& G = groups[group];
+		jobsDone.wait(lock, [&G] { return G.pendingJobs == 0; });
+		toRun.swap(G.finishers);
+		G.finished = true;
+		error = firstError;
+		firstError = nullptr;
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	for (auto& f : toRun) {
+		f();
+	}
+}
+
+inline bool AssetLoader::ready(int group) {
+	std::unique_lock<std::mutex> lock(mtx);
+	auto it = groups.find(group);
+	return it == groups.end() || it->second.pendingJobs == 0;
+}
+
+inline bool AssetLoader::finished(int group) {
+	std::unique_lock<std::mutex> lock(mtx);
+	auto it = groups.find(group);
+	return it == groups.end() || it->second.finished;
+}
+
+inline int AssetLoader::nextGroup() {
+	std::unique_lock<std::mutex> lock(mtx);
+	for (auto& G : groups) {
+		if (!G.second.finished) {
+			return G.first;
+		}
+	}
+	return -1;
+}
+
+inline void AssetLoader::stop() {
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		quitting = true;
+		jobs.clear();
+		jobReady.notify_all();
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+	workers.clear();
+	groups.clear();
+	currentGroup = 0;
+}
+
+inline void AssetLoader::workerLoop() {
+	while (true) {
+		int group;
+		std::function<void()> work;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			jobReady.wait(lock, [this] { return quitting || !jobs.empty(); });
+			if (quitting) {
+				return;
+			}
+			group = jobs.front().first;
+			work = std::move(jobs.front().second);
+			jobs.pop_front();
+		}
+		try {
+			work();
+		}
+		catch (...) {
+			std::unique_lock<std::mutex> lock(mtx);
+			if (!firstError) {
+				firstError = std::current_exception();
+			}
+		}
+		std::unique_lock<std::mutex> lock(mtx);
+		if (--groups[group].pendingJobs == 0) {
+			jobsDone.notify_all();
+		}
+	}
+}
+
 class BaseProject;
 
 struct VertexBindingDescriptorElement {
@@ -184,6 +627,7 @@ struct VertexDescriptorElement {
 struct VertexComponent {
 	bool hasIt;
 	uint32_t offset;
+	VkFormat format;
 };
 
 struct VertexDescriptor {
@@ -200,6 +644,11 @@ struct VertexDescriptor {
 
 	void init(BaseProject* bp, std::vector<VertexBindingDescriptorElement> B, std::vector<VertexDescriptorElement> E);
 	void cleanup();
+	uint64_t layoutHash();
+	// Compact layouts: positions in R16G16B16A16_SNORM, octahedral normals in R16G16_SNORM,
+	// UVs in R16G16_UNORM. Models are loaded in floatLayout() and packed by Model::quantize.
+	bool quantized();
+	VertexDescriptor floatLayout();
 
 	std::vector<VkVertexInputBindingDescription> getBindingDescription();
 	std::vector<VkVertexInputAttributeDescription>
@@ -208,40 +657,215 @@ struct VertexDescriptor {
 
 enum ModelType { OBJ, GLTF, MGCG };
 
+// A level of detail: a range of Model::indices, and the estimated distance of its surface
+// from the full mesh, in model units
+struct ModelLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+};
+
+const uint32_t MODEL_MAX_LODS = 4;
+
+// What a Model keeps in host memory once its buffers are on the GPU
+enum MeshResidency {
+	RESIDENCY_GPU_ONLY,		// vertices and indices are released
+	RESIDENCY_POSITIONS,	// model-space positions, and the indices of the full mesh, for CPU queries
+	RESIDENCY_FULL			// vertices and indices are kept as uploaded
+};
+
+// Cooked meshes are stored next to their source as <file>.cache: this header,
+// followed by the vertex blob and the 32-bit indices.
+// Bump MODEL_CACHE_VERSION whenever the loaders change the data they produce.
+const uint32_t MODEL_CACHE_VERSION = 6;
+
+struct ModelCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t modelType;
+	uint32_t stride;
+	uint32_t optimized;
+	uint32_t lodLevels;
+	uint32_t lodCount;
+	ModelLod lods[MODEL_MAX_LODS];
+	float boundsCenter[3];
+	float boundsRadius;
+	uint64_t layoutHash;
+	uint64_t sourceHash;
+	uint64_t vertexBytes;
+	uint64_t indexCount;
+	float Wm[16];
+	float Qm[16];
+};
+
+// The pipeline cache is kept on disk as BaseProject::pipelineCacheFile: this header, followed
+// by the data of vkGetPipelineCacheData. The data is only handed back to the driver when it
+// was written by the same device and driver version.
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+struct PipelineCacheHeader {
+	char magic[4];		// "MGPC"
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint32_t reserved;
+	uint64_t dataSize;
+	uint64_t dataHash;	// hashBytes of the data
+};
+
 class Model {
 	BaseProject* BP;
 
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	Allocation vertexBufferMemory;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	Allocation indexBufferMemory;
 	VertexDescriptor* VD;
+	// layout written by the loaders: VD, or its float layout when VD is quantized
+	VertexDescriptor* LD;
 
 public:
 	glm::mat4 Wm;
+	// maps quantized positions back to model space (identity for float layouts):
+	// the world matrix of a quantized model must be multiplied by it, see applyQuantization()
+	glm::mat4 Qm;
+	// UINT16 whenever the indices fit, see createIndexBuffer()
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	// simplified levels generated after loading (up to MODEL_MAX_LODS - 1), set before init();
+	// lods[0] is the full mesh, and the levels follow it in indices
+	uint32_t lodLevels = 0;
+	std::vector<ModelLod> lods;
+	// projected error, in pixels, under which selectLod() moves to a coarser level
+	float lodPixelError = 1.0f;
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	// keep the vertex and index buffers in host-visible memory, for meshes rewritten by the CPU;
+	// static meshes are copied to device-local memory
+	bool hostVisible = false;
+	// reorder triangles and vertices after loading (see MeshOptimizer.hpp);
+	// set to false before init() to keep the order of the source file
+	bool optimizeMesh = true;
+	// host copies kept after upload, set before init(); host-visible meshes always keep them all
+	MeshResidency residency = RESIDENCY_GPU_ONLY;
+	// applied to the UVs when loading, set before init() to the Texture::uvScaleOffset of the
+	// texture the model is drawn with
+	glm::vec4 uvScaleOffset = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
 	std::vector<unsigned char> vertices{};
 	std::vector<uint32_t> indices{};
+	// filled with RESIDENCY_POSITIONS, one per vertex
+	std::vector<glm::vec3> positions{};
+	// sizes of the GPU buffers, valid whatever the residency: indexCount is the full mesh (lods[0])
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	// file it was loaded from ("[mesh]" for initMesh() unless set before), and the binds and
+	// draws recorded with it, for BaseProject::printResourceUsage()
+	std::string name;
+	uint32_t bindCount = 0;
+	uint32_t drawCount = 0;
 	void loadModelOBJ(std::string file);
 	void loadModelGLTF(std::string file, bool encoded);
 	void createIndexBuffer();
 	void createVertexBuffer();
+	void applyResidency();
+	bool loadCache(const std::string& cacheFile, uint64_t sourceHash, ModelType MT, bool allowPacked);
+	void saveCache(const std::string& cacheFile, uint64_t sourceHash, ModelType MT);
+	void generateLods();
+	void optimize();
+	void quantize();
+	void applyUvScaleOffset();
+	float projectedScale(const glm::mat4& world, const glm::mat4& viewPrj, float pixelsPerUnit);
+	uint32_t selectLod(const glm::mat4& world, const glm::mat4& viewPrj, float pixelsPerUnit, uint32_t current);
+	float screenSize(const glm::mat4& world, const glm::mat4& viewPrj, float pixelsPerUnit);
+	VkDrawIndexedIndirectCommand lodDraw(uint32_t lod, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+	void load(std::string file, ModelType MT);
 
 	void init(BaseProject* bp, VertexDescriptor* VD, std::string file, ModelType MT);
+	void initAsync(BaseProject* bp, VertexDescriptor* VD, std::string file, ModelType MT);
 	void initMesh(BaseProject* bp, VertexDescriptor* VD);
 	void cleanup();
 	void bind(VkCommandBuffer commandBuffer);
+	void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1);
+	VkDeviceSize deviceBytes() const;
+};
+
+// Takes the quantized positions of M back to model space (Qm, identity for float layouts) in
+// the matrices of its uniform block: to be called after nMat is computed from mMat, since the
+// normals are not quantized
+inline void applyQuantization(glm::mat4& mMat, glm::mat4& mvpMat, const Model& M) {
+	mMat *= M.Qm;
+	mvpMat *= M.Qm;
+}
+
+// Sampler state used as the key of the sampler cache of BaseProject
+struct SamplerKey {
+	VkFilter magFilter;
+	VkFilter minFilter;
+	VkSamplerAddressMode addressModeU;
+	VkSamplerAddressMode addressModeV;
+	VkSamplerAddressMode addressModeW;
+	VkSamplerMipmapMode mipmapMode;
+	VkBool32 anisotropyEnable;
+	float maxAnisotropy;
+	float maxLod;
+
+	bool operator<(const SamplerKey& o) const {
+		return std::tie(magFilter, minFilter, addressModeU, addressModeV, addressModeW, mipmapMode, anisotropyEnable, maxAnisotropy, maxLod) <
+			std::tie(o.magFilter, o.minFilter, o.addressModeU, o.addressModeV, o.addressModeW, o.mipmapMode, o.anisotropyEnable, o.maxAnisotropy, o.maxLod);
+	}
+};
+
+// A texture packed into an atlas image by the AtlasCook tool, see BaseProject::loadAtlasManifest
+struct AtlasTile {
+	std::string atlas;		// image to load in place of the texture
+	float maxLod;			// coarsest level whose texels do not mix with the other tiles
+	glm::vec4 uvScaleOffset;
 };
 
 struct Texture {
 	BaseProject* BP;
 	uint32_t mipLevels;
-	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView textureImageView;
-	VkSampler textureSampler;
+	VkImage textureImage = VK_NULL_HANDLE;
+	Allocation textureImageMemory;
+	VkImageView textureImageView = VK_NULL_HANDLE;
+	VkSampler textureSampler = VK_NULL_HANDLE;
 	int imgs;
 	static const int maxImgs = 6;
 
+	// key in the texture registry of BaseProject, empty for textures that are not shared
+	std::string registryKey;
+
+	// decoded images, waiting to be uploaded: texelBytes 1 for VK_FORMAT_R8_UNORM textures
+	// (single channel, e.g. distance fields), 4 otherwise
+	int texWidth, texHeight;
+	int texelBytes = 4;
+	std::vector<stbi_uc*> pixels;
+
+	// cooked KTX2 image next to the source file (block compressed, with all its mip levels),
+	// used in place of the decoded pixels when present
+	AssetFile cookedFile;
+	Ktx2::Image cooked;
+	std::string sourceFile;
+	// format of textureImage: the requested one, or the block format of the cooked image
+	VkFormat imageFormat;
+	// where the texture lies in textureImage: a tile of an atlas for the textures listed in the
+	// atlas manifest, the whole image otherwise. Models drawn with the texture take it into
+	// their UVs (Model::uvScaleOffset)
+	glm::vec4 uvScaleOffset = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	float atlasMaxLod = -1;
+	// file it was loaded from, and the descriptor sets made with it, for BaseProject::printResourceUsage()
+	std::string name;
+	uint32_t bindCount = 0;
+
+	bool locateInAtlas(std::string& file);
+	bool hasCookedFormat(VkFormat Fmt) const;
+	bool useCookedImage(VkFormat Fmt) const;
+	void loadTextureImages(std::string files[], bool useCooked = false);
+	bool loadCookedImage(const std::string& file);
+	void uploadTextureImage(VkFormat Fmt);
+	void uploadCookedImage(VkFormat Fmt);
+	void convertEquirectToCube(int faceSize);
 	void createTextureImage(std::string files[], VkFormat Fmt);
 	void createTextureImageView(VkFormat Fmt);
 	void createTextureSampler(VkFilter magFilter,
@@ -255,7 +879,13 @@ struct Texture {
 	);
 
 	void init(BaseProject* bp, std::string file, VkFormat Fmt, bool initSampler);
+	void initAsync(BaseProject* bp, std::string file, VkFormat Fmt, bool initSampler);
+	// Texels the texture needs across the screen this frame, for mip streaming (see
+	// BaseProject::textureBudget); ignored by textures that are not streamed
+	void requestResolution(float pixels);
 	void initCubic(BaseProject* bp, std::string files[6]);
+	void initEquirect(BaseProject* bp, std::string file, int faceSize);
+	void initEquirectAsync(BaseProject* bp, std::string file, int faceSize);
 	void cleanup();
 };
 
@@ -291,6 +921,8 @@ struct Pipeline {
 	VkPolygonMode polyModel;
 	VkCullModeFlagBits CM;
 	bool transp;
+	// float specialization constants of the fragment shader, constant_id 0, 1, ... in order
+	std::vector<float> fragConstants;
 
 	VertexDescriptor* VD;
 
@@ -299,31 +931,97 @@ struct Pipeline {
 		std::vector<DescriptorSetLayout*> D);
 	void setAdvancedFeatures(VkCompareOp _compareOp, VkPolygonMode _polyModel,
 		VkCullModeFlagBits _CM, bool _transp);
+	void setFragmentConstants(std::vector<float> constants);
 	void create();
 	void destroy();
 	void bind(VkCommandBuffer commandBuffer);
 
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	VkShaderModule createShaderModule(const unsigned char* code, size_t size);
+	void cleanup();
+};
+
+// Slot of a uniform binding in the UniformRing: the same offset in the region of every image
+struct UniformSlot {
+	uint32_t block = 0;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;		// aligned, 0 for bindings that are not uniform buffers
+};
+
+// Uniform buffers of the descriptor sets, sub-allocated from a few large host-visible buffers
+// mapped once for their whole life. Each block holds one region per swap chain image, the
+// frames of the ring, and a uniform binding takes the same slot, aligned to
+// minUniformBufferOffsetAlignment, in every region: DescriptorSet::map() is a plain write into
+// the region of the image being prepared, while the GPU may still read the others. When the
+// memory type is not HOST_COHERENT, flush() makes the region of an image visible before the
+// frame is submitted.
+struct UniformRing {
+	BaseProject* BP;
+
+	// set before the first descriptor set: bytes of a region of each block, and the memory
+	// asked for (HOST_VISIBLE alone also accepts non-coherent types, flushed every frame)
+	VkDeviceSize regionSize = 64 * 1024;
+	VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	struct Block {
+		VkBuffer buffer;
+		Allocation memory;
+		VkDeviceSize regionSize;
+		VkDeviceSize top = 0;	// first free byte of each region
+	};
+	std::vector<Block> blocks;
+	uint32_t images = 0;
+	VkDeviceSize alignment = 1;
+	uint32_t live = 0;
+	// released slots by size, taken again before the free space of the blocks
+	std::multimap<VkDeviceSize, UniformSlot> freeSlots;
+
+	void init(BaseProject* bp);
+	UniformSlot allocate(VkDeviceSize size);
+	void release(UniformSlot& S);
+	VkBuffer buffer(const UniformSlot& S) const;
+	VkDeviceSize offset(const UniformSlot& S, int currentImage) const;
+	void* data(const UniformSlot& S, int currentImage) const;
+	void flush(int currentImage);
+	void printStats(std::ostream& out) const;
 	void cleanup();
 };
 
 struct DescriptorSet {
 	BaseProject* BP;
 
-	std::vector<std::vector<VkBuffer>> uniformBuffers;
-	std::vector<std::vector<VkDeviceMemory>> uniformBuffersMemory;
+	// one per binding of the layout, see UniformRing
+	std::vector<UniformSlot> uniformSlots;
 	std::vector<VkDescriptorSet> descriptorSets;
 	DescriptorSetLayout* Layout;
 
-	std::vector<bool> toFree;
+	// textures of the sampler bindings, rewritten by updateTextures() when streaming replaces their images
+	std::vector<Texture*> textures;
 
 	void init(BaseProject* bp, DescriptorSetLayout* L,
 		std::vector<Texture*>Txs);
+	void updateTextures(int currentImage = -1);
 	void cleanup();
 	void bind(VkCommandBuffer commandBuffer, Pipeline& P, int setId, int currentImage);
 	void map(int currentImage, void* src, int slot);
 };
 
+// Draw parameters that change every frame without recording the command buffers again:
+// each slot is a VkDrawIndexedIndirectCommand, one array per swap chain image, kept mapped.
+// Like DescriptorSet, it is created with the pipelines and the descriptor sets.
+struct IndirectDraws {
+	BaseProject* BP;
+
+	std::vector<VkBuffer> buffers;
+	std::vector<Allocation> buffersMemory;
+	std::vector<VkDrawIndexedIndirectCommand*> commands;
+
+	// every slot of every image starts as defaults[slot]
+	void init(BaseProject* bp, const std::vector<VkDrawIndexedIndirectCommand>& defaults);
+	void cleanup();
+	void set(int currentImage, uint32_t slot, const VkDrawIndexedIndirectCommand& C);
+	void draw(VkCommandBuffer commandBuffer, int currentImage, uint32_t slot);
+};
+
 
 struct PoolSizes {
 	int uniformBlocksInPool = 0;
@@ -339,6 +1037,8 @@ class BaseProject {
 	friend class Pipeline;
 	friend class DescriptorSetLayout;
 	friend class DescriptorSet;
+	friend class IndirectDraws;
+	friend class UniformRing;
 public:
 	virtual void setWindowParameters() = 0;
 	inline void run() {
@@ -346,7 +1046,16 @@ public:
 
 		setWindowParameters();
 		initWindow();
-		initVulkan();
+		try {
+			initVulkan();
+		}
+		catch (...) {
+			// loader threads may still be writing into the assets of the application
+			assetLoader.stop();
+			textureStreamer.stop();
+			stopPrefetching();
+			throw;
+		}
 		mainLoop();
 		cleanup();
 	}
@@ -369,6 +1078,19 @@ protected:
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 	VkCommandPool commandPool;
+	// equal to graphicsQueue / commandPool when the device has no separate transfer family
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+	uint32_t graphicsQueueFamily = 0;
+	uint32_t transferQueueFamily = 0;
+	// cooked BC1/BC3/BC7 textures can be sampled
+	bool textureCompressionBC = false;
+	// textureCompressionBC for the jobs queued by localLoad(), which start before the physical
+	// device is picked: set by initVulkan() once it is
+	std::promise<bool> textureCompressionBCKnown;
+	std::shared_future<bool> textureCompressionBCReady;
+	// indirect draws may start past instance 0 (IndirectDraws)
+	bool drawIndirectFirstInstance = false;
 	std::vector<VkCommandBuffer> commandBuffers;
 
 	VkSwapchainKHR swapChain;
@@ -384,12 +1106,12 @@ protected:
 	VkDebugUtilsMessengerEXT debugMessenger;
 
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	Allocation depthImageMemory;
 	VkImageView depthImageView;
 
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 	VkImage colorImage;
-	VkDeviceMemory colorImageMemory;
+	Allocation colorImageMemory;
 	VkImageView colorImageView;
 
 	std::vector<VkFramebuffer> swapChainFramebuffers;
@@ -405,6 +1127,131 @@ protected:
    VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
+	AssetLoader assetLoader;
+	// Pack written by the assetcook target, relative to the working directory. Assets that are
+	// not in it (or all of them, when there is no pack) are read from loose files.
+	std::string assetPackFile = "assets.pack";
+	// Reads the loose asset files queued by localLoad() ahead of the jobs that decode them,
+	// see prefetchAsset(). Set prefetchAssets to false to let the jobs read them on their own
+	AsyncIO::Reader fileReader;
+	bool prefetchAssets = true;
+	// Manifest written by the AtlasCook tool: the textures listed in it are loaded from their
+	// atlas instead, see Texture::locateInAtlas(). Nothing is atlased when it is missing
+	std::string atlasManifestFile = "textures/Atlas.atlas";
+	std::map<std::string, AtlasTile> atlasTiles;
+
+	// Device memory of buffers and images, sub-allocated from a few large blocks:
+	// see MemoryAllocator.hpp
+	MemoryAllocator memoryAllocator;
+	// uniform buffers of the descriptor sets, see UniformRing
+	UniformRing uniformRing;
+
+	// Pipeline cache, read from pipelineCacheFile (relative to the working directory) at
+	// startup and written back at cleanup(): the pipelines rebuilt at every swap chain
+	// recreation, and at the next launches, skip most of the shader compilation
+	std::string pipelineCacheFile = "pipeline.cache";
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	// pipelines created by Pipeline::create since the last logPipelineCreation(): time spent
+	// in the driver, summed over the threads of createPipelines(), and time waited for it
+	std::mutex pipelineStatsMutex;
+	uint32_t pipelinesCreated = 0;
+	float pipelineCreationMs = 0.0f;
+	float pipelineWaitMs = 0.0f;
+	bool creatingPipelines = false;
+
+	// Texture registry: Textures created from the same file and format share one image,
+	// released when the last of them is cleaned up
+	struct RegisteredTexture {
+		VkImage image = VK_NULL_HANDLE;
+		Allocation memory;
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t mipLevels = 0;
+		int refCount = 0;
+		// textures holding the handles, updated when streaming replaces the image
+		std::vector<Texture*> users;
+	};
+	std::map<std::string, RegisteredTexture> textureRegistry;
+
+	// Sampler cache: one VkSampler for each distinct sampler state
+	struct RegisteredSampler {
+		VkSampler sampler;
+		int refCount;
+	};
+	std::map<SamplerKey, RegisteredSampler> samplerCache;
+
+	// Mip streaming of cooked textures: only the levels of at most streamingTailSize texels
+	// are uploaded when a texture is loaded. The finer levels are read by a background thread
+	// as the textures request them (Texture::requestResolution), the most recently needed
+	// first, and the least recently needed are evicted to keep the streamed levels of all the
+	// textures within textureBudget bytes. A budget of 0 loads every level up front.
+	VkDeviceSize textureBudget = 128ull << 20;
+	uint32_t streamingTailSize = 64;
+
+	struct StreamedTexture {
+		AssetFile file;				// the KTX2 levels are read from here
+		Ktx2::Image image;
+		VkFormat format;
+		uint32_t tailLevel;			// coarser levels are always resident
+		uint32_t residentLevel;		// finest level in the current image
+		uint32_t plannedLevel;		// finest level after the streaming job
+		uint32_t wantedLevel = 0;	// finest level useful on screen, all of them until requested
+		uint32_t frameWanted = 0;	// finest level requested during the current frame
+		uint64_t lastNeeded = 0;	// frame of the last request
+	};
+	std::map<std::string, StreamedTexture> streamedTextures;
+	// released while the streaming job reads them: kept alive until the job is done
+	std::vector<std::map<std::string, StreamedTexture>::node_type> releasedStreams;
+	std::set<DescriptorSet*> liveDescriptorSets;
+	// textures and models between init and cleanup, for printResourceUsage()
+	std::set<Texture*> liveTextures;
+	std::set<Model*> liveModels;
+	// model of the last Model::bind() recorded, credited with the indirect draws that follow
+	Model* boundModel = nullptr;
+	struct TextureSwap {
+		std::string key;
+		uint32_t level;
+		uint32_t mipLevels;
+		VkImage image;
+		Allocation memory;
+		VkImageView view;
+	};
+	AssetLoader textureStreamer;	// one thread, one job at a time
+	bool streamingJob = false;
+	std::vector<std::pair<std::string, uint32_t>> streamingChanges;	// key, new finest level
+	std::vector<std::vector<unsigned char>> streamingData;			// levels read by the job
+	std::vector<TextureSwap> textureSwaps;
+	uint64_t streamingFrame = 1;
+	// Images replaced by streaming, still used by the descriptor sets and command buffers of the
+	// swap chain images that are pending in refreshSwapChainImage()
+	struct RetiredImage {
+		VkImage image;
+		Allocation memory;
+		VkImageView view;
+		std::vector<bool> pending;		// per swap chain image
+	};
+	std::vector<RetiredImage> retiredImages;
+	// per swap chain image: textures whose image changed since its command buffer was recorded
+	std::vector<std::set<Texture*>> staleTextures;
+
+	// Upload context: staging copies, layout transitions and mip generation are recorded into
+	// one command buffer (two, when the copies run on a transfer queue and the blits on the
+	// graphics one) and submitted once with a fence. The staging buffers are released when the
+	// fence signals. Between beginUploadBatch() and endUploadBatch() all uploads share a batch,
+	// otherwise each upload is submitted and waited on by itself
+	struct UploadBatch {
+		VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore transferDone = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		std::vector<std::pair<VkBuffer, Allocation>> stagingBuffers;
+		VkDeviceSize stagedBytes = 0;
+		int bufferCount = 0;
+		int imageCount = 0;
+	};
+	UploadBatch currentUpload;
+	std::vector<UploadBatch> uploadsInFlight;
+	bool batchingUploads = false;
+
 	inline void initWindow() {
 		glfwInit();
 
@@ -427,15 +1274,47 @@ protected:
 	}
 
 
+	// Queues asset loading (Model::initAsync, Texture::initAsync) before the Vulkan device
+	// exists, so that decoding overlaps with the rest of initVulkan(). Assets queued in load
+	// group 0 are ready for the first frame; the other groups (assetLoader.setGroup()) keep
+	// loading in background, see collectLoadGroups() and requireLoadGroup()
+	virtual void localLoad() {}
 	virtual void localInit() = 0;
 	virtual void pipelinesAndDescriptorSetsInit() = 0;
 
 	inline void initVulkan() {
-		createInstance();
-		setupDebugMessenger();
-		createSurface();
-		pickPhysicalDevice();
+		mountAssetPack(assetPackFile);
+		loadAtlasManifest();
+		if (prefetchAssets) {
+			fileReader.start();
+			std::cout << "Asset reads: " << fileReader.backendName();
+			if (!fileReader.fallbackReason().empty()) {
+				std::cout << " (io_uring: " << fileReader.fallbackReason() << ")";
+			}
+			std::cout << "\n";
+		}
+		assetLoader.start();
+		textureStreamer.start(1);
+		textureCompressionBCReady = textureCompressionBCKnown.get_future().share();
+		localLoad();
+		assetLoader.setGroup(0);
+
+		try {
+			createInstance();
+			setupDebugMessenger();
+			createSurface();
+			pickPhysicalDevice();
+		}
+		catch (...) {
+			// the jobs waiting for it decode the images
+			textureCompressionBCKnown.set_value(false);
+			throw;
+		}
+		textureCompressionBCKnown.set_value(textureCompressionBC);
 		createLogicalDevice();
+		memoryAllocator.init(physicalDevice, device);
+		uniformRing.init(this);
+		createPipelineCache();
 		createSwapChain();
 		createImageViews();
 		createRenderPass();
@@ -443,15 +1322,187 @@ protected:
 		createColorResources();
 		createDepthResources();
 		createFramebuffers();
+
+		// Everything uploaded from here to endUploadBatch() goes to the GPU in one submission
+		beginUploadBatch();
 		localInit();
 
+		// Join point of the asset loader: GPU uploads are recorded here, on the main thread
+		assetLoader.finish(0);
+		endUploadBatch();
+
 		createDescriptorPool();
 		pipelinesAndDescriptorSetsInit();
+		logPipelineCreation("startup");
+		std::cout << "Device memory at startup:\n";
+		memoryAllocator.printStats(std::cout);
+		uniformRing.printStats(std::cout);
 
 		createCommandBuffers();
 		createSyncObjects();
 	}
 
+	// Why the data of a pipeline cache file cannot be used on this device, nullptr if it can
+	static inline const char* pipelineCacheMismatch(const unsigned char* data, size_t size,
+		const VkPhysicalDeviceProperties& P) {
+		PipelineCacheHeader H;
+		if (size < sizeof(H)) {
+			return "truncated file";
+		}
+		memcpy(&H, data, sizeof(H));
+		if (memcmp(H.magic, "MGPC", 4) != 0 || H.version != PIPELINE_CACHE_VERSION) {
+			return "unknown format";
+		}
+		if (H.vendorID != P.vendorID || H.deviceID != P.deviceID ||
+			memcmp(H.pipelineCacheUUID, P.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			return "written by another device";
+		}
+		if (H.driverVersion != P.driverVersion) {
+			return "written by another driver version";
+		}
+		if (H.dataSize != size - sizeof(H) || hashBytes(data + sizeof(H), (size_t)H.dataSize) != H.dataHash) {
+			return "corrupted data";
+		}
+		// the header of the data itself (VkPipelineCacheHeaderVersionOne) must agree
+		const unsigned char* vk = data + sizeof(H);
+		uint32_t vkHeader[4];
+		if (H.dataSize < 16 + VK_UUID_SIZE) {
+			return "corrupted data";
+		}
+		memcpy(vkHeader, vk, sizeof(vkHeader));
+		if (vkHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || vkHeader[2] != P.vendorID ||
+			vkHeader[3] != P.deviceID || memcmp(vk + 16, P.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			return "written by another device";
+		}
+		return nullptr;
+	}
+
+	inline void createPipelineCache() {
+		VkPhysicalDeviceProperties P;
+		vkGetPhysicalDeviceProperties(physicalDevice, &P);
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		MappedFile file;
+		if (file.open(pipelineCacheFile)) {
+			const char* mismatch = pipelineCacheMismatch(file.data, file.size, P);
+			if (mismatch == nullptr) {
+				cacheInfo.initialDataSize = file.size - sizeof(PipelineCacheHeader);
+				cacheInfo.pInitialData = file.data + sizeof(PipelineCacheHeader);
+			}
+			else {
+				std::cout << "Ignoring pipeline cache " << pipelineCacheFile << ": " << mismatch << "\n";
+			}
+		}
+
+		VkResult result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+		if (result != VK_SUCCESS && cacheInfo.initialDataSize > 0) {
+			std::cout << "Pipeline cache " << pipelineCacheFile << " rejected by the driver\n";
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+		}
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+		std::cout << "Pipeline cache: " << cacheInfo.initialDataSize << " B loaded from " << pipelineCacheFile << "\n";
+	}
+
+	inline void savePipelineCache() {
+		VkPhysicalDeviceProperties P;
+		vkGetPhysicalDeviceProperties(physicalDevice, &P);
+
+		size_t dataSize = 0;
+		std::vector<unsigned char> data;
+		VkResult result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+		if (result == VK_SUCCESS) {
+			data.resize(dataSize);
+			result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data());
+		}
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+		pipelineCache = VK_NULL_HANDLE;
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			std::cout << "Could not read the pipeline cache\n";
+			return;
+		}
+		data.resize(dataSize);
+
+		PipelineCacheHeader H{};
+		memcpy(H.magic, "MGPC", 4);
+		H.version = PIPELINE_CACHE_VERSION;
+		H.vendorID = P.vendorID;
+		H.deviceID = P.deviceID;
+		H.driverVersion = P.driverVersion;
+		memcpy(H.pipelineCacheUUID, P.pipelineCacheUUID, VK_UUID_SIZE);
+		H.dataSize = data.size();
+		H.dataHash = hashBytes(data.data(), data.size());
+
+		// written to a temporary file first, like the mesh caches
+		std::string tmpFile = pipelineCacheFile + ".tmp";
+		std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			std::cout << "Could not write pipeline cache: " << pipelineCacheFile << "\n";
+			return;
+		}
+		out.write((const char*)&H, sizeof(H));
+		out.write((const char*)data.data(), data.size());
+		out.close();
+		if (!out) {
+			std::remove(tmpFile.c_str());
+			std::cout << "Could not write pipeline cache: " << pipelineCacheFile << "\n";
+			return;
+		}
+		std::remove(pipelineCacheFile.c_str());
+		if (std::rename(tmpFile.c_str(), pipelineCacheFile.c_str()) != 0) {
+			std::remove(tmpFile.c_str());
+			std::cout << "Could not write pipeline cache: " << pipelineCacheFile << "\n";
+			return;
+		}
+		std::cout << "Pipeline cache: " << data.size() << " B written to " << pipelineCacheFile << "\n";
+	}
+
+	// Creates the pipelines on one thread each, so that the driver compiles their shaders
+	// concurrently. They share pipelineCache, which the implementation synchronizes.
+	// Returns when all of them exist; the first error is thrown again here
+	inline void createPipelines(const std::vector<Pipeline*>& pipelines) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		creatingPipelines = true;
+		std::vector<std::thread> threads;
+		std::vector<std::exception_ptr> errors(pipelines.size());
+		for (size_t i = 0; i < pipelines.size(); i++) {
+			threads.emplace_back([&pipelines, &errors, i]() {
+				try {
+					pipelines[i]->create();
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		creatingPipelines = false;
+		auto t1 = std::chrono::high_resolution_clock::now();
+		pipelineWaitMs += std::chrono::duration<float, std::milli>(t1 - t0).count();
+
+		for (auto& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+	}
+
+	inline void logPipelineCreation(const char* when) {
+		std::cout << "Pipelines: " << pipelinesCreated << " created in " << pipelineWaitMs
+			<< " ms, " << pipelineCreationMs << " ms of driver time (" << when << ")\n";
+		pipelinesCreated = 0;
+		pipelineCreationMs = 0.0f;
+		pipelineWaitMs = 0.0f;
+	}
+
 	inline void createInstance() {
 		std::cout << "Starting createInstance()\n" << std::flush;
 		VkApplicationInfo appInfo{};
@@ -690,6 +1741,11 @@ protected:
 		if (physicalDevice == VK_NULL_HANDLE) {
 			throw std::runtime_error("failed to find a suitable GPU!");
 		}
+
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+		drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
 	}
 
 	inline bool isDeviceSuitable(VkPhysicalDevice device, deviceReport& devRep) {
@@ -746,6 +1802,15 @@ protected:
 			i++;
 		}
 
+		// Prefer a transfer-only family (the DMA engine) over a compute one
+		for (uint32_t j = 0; j < queueFamilyCount; j++) {
+			VkQueueFlags flags = queueFamilies[j].queueFlags;
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) &&
+				(!indices.transferFamily.has_value() || !(flags & VK_QUEUE_COMPUTE_BIT))) {
+				indices.transferFamily = j;
+			}
+		}
+
 		return indices;
 	}
 
@@ -822,6 +1887,9 @@ protected:
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies =
 		{ indices.graphicsFamily.value(), indices.presentFamily.value() };
+		if (indices.transferFamily.has_value()) {
+			uniqueQueueFamilies.insert(indices.transferFamily.value());
+		}
 
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -833,8 +1901,13 @@ protected:
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+		deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 		deviceFeatures.sampleRateShading = VK_TRUE;
 		deviceFeatures.fillModeNonSolid = VK_TRUE;
 
@@ -863,6 +1936,17 @@ protected:
 
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+		graphicsQueueFamily = indices.graphicsFamily.value();
+		if (indices.transferFamily.has_value()) {
+			transferQueueFamily = indices.transferFamily.value();
+			vkGetDeviceQueue(device, transferQueueFamily, 0, &transferQueue);
+			std::cout << "Uploads on dedicated transfer queue family " << transferQueueFamily << "\n";
+		}
+		else {
+			transferQueueFamily = graphicsQueueFamily;
+			transferQueue = graphicsQueue;
+		}
 	}
 
 	inline void createSwapChain() {
@@ -1125,13 +2209,23 @@ protected:
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		poolInfo.flags = 0; // Optional
+		// command buffers are recorded again one at a time, see refreshSwapChainImage()
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 		VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
 		if (result != VK_SUCCESS) {
 			PrintVkError(result);
 			throw std::runtime_error("failed to create command pool!");
 		}
+
+		if (transferQueueFamily != graphicsQueueFamily) {
+			poolInfo.queueFamilyIndex = transferQueueFamily;
+			result = vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create transfer command pool!");
+			}
+		}
 	}
 
 	inline void createColorResources() {
@@ -1202,7 +2296,7 @@ protected:
 		VkImageTiling tiling, VkImageUsageFlags usage,
 		VkImageCreateFlags cflags,
 		VkMemoryPropertyFlags properties, VkImage& image,
-		VkDeviceMemory& imageMemory) {
+		Allocation& imageMemory) {
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1228,20 +2322,24 @@ protected:
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-			properties);
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate image memory!");
-		}
+		imageMemory = memoryAllocator.allocate(memRequirements, properties,
+			tiling == VK_IMAGE_TILING_OPTIMAL ? RESOURCE_OPTIMAL : RESOURCE_LINEAR);
 
-		vkBindImageMemory(device, image, imageMemory, 0);
+		vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 	}
 
 	void generateMipmaps(VkImage image, VkFormat imageFormat,
+		int32_t texWidth, int32_t texHeight,
+		uint32_t mipLevels, int layerCount) {
+		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		recordGenerateMipmaps(commandBuffer, image, imageFormat,
+			texWidth, texHeight, mipLevels, layerCount);
+		endSingleTimeCommands(commandBuffer);
+	}
+
+	// Expects every level in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, with level 0 filled;
+	// leaves them all in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	void recordGenerateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat,
 		int32_t texWidth, int32_t texHeight,
 		uint32_t mipLevels, int layerCount) {
 		VkFormatProperties formatProperties;
@@ -1253,8 +2351,6 @@ protected:
 			throw std::runtime_error("texture image format does not support linear blitting!");
 		}
 
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.image = image;
@@ -1325,8 +2421,6 @@ protected:
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 			0, nullptr, 0, nullptr,
 			1, &barrier);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 
 	void transitionImageLayout(VkImage image, VkFormat format,
@@ -1396,7 +2490,12 @@ protected:
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t
 		width, uint32_t height, int layerCount) {
 		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		recordCopyBufferToImage(commandBuffer, buffer, image, width, height, layerCount);
+		endSingleTimeCommands(commandBuffer);
+	}
 
+	void recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image,
+		uint32_t width, uint32_t height, int layerCount) {
 		VkBufferImageCopy region{};
 		region.bufferOffset = 0;
 		region.bufferRowLength = 0;
@@ -1410,8 +2509,6 @@ protected:
 
 		vkCmdCopyBufferToImage(commandBuffer, buffer, image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 
 	inline VkCommandBuffer beginSingleTimeCommands() {
@@ -1448,7 +2545,8 @@ protected:
 
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 		VkMemoryPropertyFlags properties,
-		VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+		VkBuffer& buffer, Allocation& bufferMemory,
+		AllocationStrategy strategy = STRATEGY_BUDDY) {
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = size;
@@ -1465,39 +2563,847 @@ protected:
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex =
-			findMemoryType(memRequirements.memoryTypeBits, properties);
+		bufferMemory = memoryAllocator.allocate(memRequirements, properties, RESOURCE_LINEAR, strategy);
 
-		result = vkAllocateMemory(device, &allocInfo, nullptr,
-			&bufferMemory);
-		if (result != VK_SUCCESS) {
-			PrintVkError(result);
-			throw std::runtime_error("failed to allocate vertex buffer memory!");
-		}
+		vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+	}
 
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);
+	// Adds a reference to a registry entry. Returns false if the texture is new, and must be
+	// created and published by the caller
+	inline bool reserveTexture(const std::string& key) {
+		RegisteredTexture& RT = textureRegistry[key];
+		RT.refCount++;
+		return RT.refCount > 1;
 	}
 
-	uint32_t findMemoryType(uint32_t typeFilter,
-		VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+	inline void publishTexture(const std::string& key, Texture& T) {
+		RegisteredTexture& RT = textureRegistry[key];
+		RT.image = T.textureImage;
+		RT.memory = T.textureImageMemory;
+		RT.view = T.textureImageView;
+		RT.mipLevels = T.mipLevels;
+		RT.users.push_back(&T);
+	}
 
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) &&
-				(memProperties.memoryTypes[i].propertyFlags & properties) ==
-				properties) {
-				return i;
-			}
+	inline void adoptTexture(const std::string& key, Texture& T) {
+		RegisteredTexture& RT = textureRegistry[key];
+		if (RT.image == VK_NULL_HANDLE) {
+			throw std::runtime_error("shared texture used before being loaded: " + key);
 		}
+		T.textureImage = RT.image;
+		T.textureImageMemory = RT.memory;
+		T.textureImageView = RT.view;
+		T.mipLevels = RT.mipLevels;
+		RT.users.push_back(&T);
+	}
 
-		throw std::runtime_error("failed to find suitable memory type!");
+	inline void releaseTexture(const std::string& key, Texture* T) {
+		auto it = textureRegistry.find(key);
+		if (it == textureRegistry.end()) {
+			return;
+		}
+		auto& users = it->second.users;
+		users.erase(std::remove(users.begin(), users.end(), T), users.end());
+		if (--it->second.refCount == 0) {
+			vkDestroyImageView(device, it->second.view, nullptr);
+			vkDestroyImage(device, it->second.image, nullptr);
+			memoryAllocator.free(it->second.memory);
+			textureRegistry.erase(it);
+			if (streamingJob) {
+				auto node = streamedTextures.extract(key);
+				if (!node.empty()) {
+					releasedStreams.push_back(std::move(node));
+				}
+			}
+			else {
+				streamedTextures.erase(key);
+			}
+		}
 	}
 
-	inline void createDescriptorPool() {
+	// Reads the tiles of atlasManifestFile. A texture edited after the manifest was written is
+	// left out, and loaded from its own file until the atlases are cooked again
+	inline void loadAtlasManifest() {
+		atlasTiles.clear();
+		AssetFile manifest;
+		if (!manifest.open(atlasManifestFile)) {
+			return;
+		}
+		std::error_code manifestError;
+		auto manifestTime = std::filesystem::last_write_time(atlasManifestFile, manifestError);
+		std::istringstream in(std::string((const char*)manifest.data, manifest.size));
+		std::string line;
+		int stale = 0;
+		while (std::getline(in, line)) {
+			std::istringstream fields(line);
+			std::string kind, texture;
+			AtlasTile T;
+			if (!(fields >> kind) || kind != "tile") {
+				continue;
+			}
+			if (!(fields >> texture >> T.atlas >> T.maxLod >> T.uvScaleOffset.x >> T.uvScaleOffset.y >>
+				T.uvScaleOffset.z >> T.uvScaleOffset.w)) {
+				std::cout << atlasManifestFile << ": malformed line \"" << line << "\"\n";
+				continue;
+			}
+			std::error_code textureError;
+			auto textureTime = std::filesystem::last_write_time(texture, textureError);
+			if (!manifestError && !textureError && textureTime > manifestTime) {
+				stale++;
+				continue;
+			}
+			atlasTiles[AssetPack::normalizeName(texture)] = T;
+		}
+		std::cout << "[ATLAS] " << atlasManifestFile << ": " << atlasTiles.size() << " textures";
+		if (stale > 0) {
+			std::cout << ", " << stale << " edited since it was written";
+		}
+		std::cout << "\n";
+	}
+
+	inline const AtlasTile* atlasTile(const std::string& file) {
+		auto it = atlasTiles.find(AssetPack::normalizeName(file));
+		return it == atlasTiles.end() ? nullptr : &it->second;
+	}
+
+	inline VkSampler acquireSampler(const SamplerKey& key) {
+		auto it = samplerCache.find(key);
+		if (it != samplerCache.end()) {
+			it->second.refCount++;
+			return it->second.sampler;
+		}
+
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = key.magFilter;
+		samplerInfo.minFilter = key.minFilter;
+		samplerInfo.addressModeU = key.addressModeU;
+		samplerInfo.addressModeV = key.addressModeV;
+		samplerInfo.addressModeW = key.addressModeW;
+		samplerInfo.anisotropyEnable = key.anisotropyEnable;
+		samplerInfo.maxAnisotropy = key.maxAnisotropy;
+		samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+		samplerInfo.unnormalizedCoordinates = VK_FALSE;
+		samplerInfo.compareEnable = VK_FALSE;
+		samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+		samplerInfo.mipmapMode = key.mipmapMode;
+		samplerInfo.mipLodBias = 0.0f;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = key.maxLod;
+
+		VkSampler sampler;
+		VkResult result = vkCreateSampler(device, &samplerInfo, nullptr,
+			&sampler);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create texture sampler!");
+		}
+		samplerCache[key] = { sampler, 1 };
+		return sampler;
+	}
+
+	inline void releaseSampler(VkSampler sampler) {
+		for (auto it = samplerCache.begin(); it != samplerCache.end(); ++it) {
+			if (it->second.sampler == sampler) {
+				if (--it->second.refCount == 0) {
+					vkDestroySampler(device, sampler, nullptr);
+					samplerCache.erase(it);
+				}
+				return;
+			}
+		}
+	}
+
+	// Creates a host-visible staging buffer owned by the current upload batch, and maps it
+	// into data. It is destroyed once the batch has completed on the GPU
+	inline VkBuffer stageUpload(VkDeviceSize size, void*& data) {
+		openUploadBatch();
+
+		VkBuffer stagingBuffer;
+		Allocation stagingBufferMemory;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer, stagingBufferMemory, STRATEGY_LINEAR);
+		data = stagingBufferMemory.mapped;
+
+		currentUpload.stagingBuffers.push_back({ stagingBuffer, stagingBufferMemory });
+		currentUpload.stagedBytes += size;
+		return stagingBuffer;
+	}
+
+	// Copies size bytes from src into dstBuffer (created with VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+	// for use as vertex or index buffer
+	inline void uploadBuffer(VkBuffer dstBuffer, const void* src, VkDeviceSize size) {
+		void* data;
+		VkBuffer stagingBuffer = stageUpload(size, data);
+		memcpy(data, src, (size_t)size);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.size = size;
+		vkCmdCopyBuffer(currentUpload.transferCommandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = dstBuffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+		if (transferQueueFamily != graphicsQueueFamily) {
+			// queue family ownership transfer: release on the transfer queue...
+			barrier.srcQueueFamilyIndex = transferQueueFamily;
+			barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+			barrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(currentUpload.transferCommandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, 1, &barrier, 0, nullptr);
+			// ...and acquire on the graphics one
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+		}
+		vkCmdPipelineBarrier(currentUpload.graphicsCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+			0, nullptr, 1, &barrier, 0, nullptr);
+
+		currentUpload.bufferCount++;
+		if (!batchingUploads) {
+			submitUploadBatch();
+			collectUploads(true);
+		}
+	}
+
+	// Copies the layers in stagingBuffer (from stageUpload) into level 0 of image, then generates
+	// the other mip levels. With levels, the copies are given by the caller and must fill every
+	// mip level, and no blit is done. The image ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	inline void uploadImage(VkBuffer stagingBuffer, VkImage image, VkFormat format,
+		int32_t width, int32_t height, uint32_t mipLevels, int layerCount,
+		const std::vector<VkBufferImageCopy>& levels = {}) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = layerCount;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(currentUpload.transferCommandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		if (levels.empty()) {
+			recordCopyBufferToImage(currentUpload.transferCommandBuffer, stagingBuffer, image,
+				static_cast<uint32_t>(width), static_cast<uint32_t>(height), layerCount);
+		}
+		else {
+			vkCmdCopyBufferToImage(currentUpload.transferCommandBuffer, stagingBuffer, image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(levels.size()), levels.data());
+		}
+
+		if (transferQueueFamily != graphicsQueueFamily) {
+			// the blits need the graphics queue: hand the image over, keeping its layout
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = transferQueueFamily;
+			barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(currentUpload.transferCommandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(currentUpload.graphicsCommandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		if (levels.empty()) {
+			recordGenerateMipmaps(currentUpload.graphicsCommandBuffer, image, format,
+				width, height, mipLevels, layerCount);
+		}
+		else {
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(currentUpload.graphicsCommandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		currentUpload.imageCount++;
+		if (!batchingUploads) {
+			submitUploadBatch();
+			collectUploads(true);
+		}
+	}
+
+	// Runs the finishers of a load group (its GPU uploads) as one upload batch
+	inline void finishLoadGroup(int group) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		beginUploadBatch();
+		assetLoader.finish(group);
+		endUploadBatch();
+		auto t1 = std::chrono::high_resolution_clock::now();
+		std::cout << "Load group " << group << " resident ("
+			<< std::chrono::duration<float, std::milli>(t1 - t0).count() << " ms on the main thread)\n";
+		memoryAllocator.printStats(std::cout);
+	}
+
+	// Reports the textures never used by a descriptor set, and the models never bound or drawn
+	// by a command buffer, with the device memory they hold. Printed at shutdown; call it at any
+	// time after the command buffers are recorded. Textures sharing an image (the texture
+	// registry, atlas tiles) count as one, used as soon as one of them is.
+	inline void printResourceUsage(std::ostream& out) {
+		struct Usage {
+			std::string name;
+			VkDeviceSize bytes = 0;
+			uint32_t binds = 0;
+			uint32_t draws = 0;
+		};
+		std::map<uint64_t, Usage> images;
+		for (Texture* T : liveTextures) {
+			// textures still loading have no image yet, each is its own entry
+			uint64_t key = T->textureImage != VK_NULL_HANDLE ? (uint64_t)T->textureImage : (uint64_t)(uintptr_t)T;
+			Usage& U = images[key];
+			U.name += (U.name.empty() ? "" : ", ") + T->name;
+			U.bytes = std::max(U.bytes, T->textureImageMemory.size);
+			U.binds += T->bindCount;
+		}
+		std::vector<Usage> unused;
+		VkDeviceSize totalBytes = 0, unusedBytes = 0;
+		for (auto& I : images) {
+			totalBytes += I.second.bytes;
+			if (I.second.binds == 0) {
+				unused.push_back(I.second);
+				unusedBytes += I.second.bytes;
+			}
+		}
+		size_t unusedImages = unused.size();
+		for (Model* M : liveModels) {
+			totalBytes += M->deviceBytes();
+			if (M->bindCount == 0 || M->drawCount == 0) {
+				unused.push_back({ M->name, M->deviceBytes(), M->bindCount, M->drawCount });
+				unusedBytes += M->deviceBytes();
+			}
+		}
+		std::sort(unused.begin(), unused.begin() + unusedImages, [](const Usage& a, const Usage& b) { return a.name < b.name; });
+		std::sort(unused.begin() + unusedImages, unused.end(), [](const Usage& a, const Usage& b) { return a.name < b.name; });
+
+		out << "Resource usage: " << images.size() << " texture images and " << liveModels.size() << " models, "
+			<< totalBytes / 1024 << " KB of device memory\n";
+		for (size_t i = 0; i < unused.size(); i++) {
+			const Usage& U = unused[i];
+			if (i < unusedImages) {
+				out << "  never bound: texture " << U.name << ", " << U.bytes / 1024 << " KB\n";
+			}
+			else {
+				out << "  " << (U.binds == 0 ? "never bound" : "never drawn") << ": model " << U.name
+					<< ", " << U.bytes / 1024 << " KB\n";
+			}
+		}
+		out << "  " << unused.size() << " unused resources, " << unusedBytes / 1024 << " KB\n";
+	}
+
+	// Uploads the groups loaded in background whose jobs are done. Groups are finished in
+	// order, so that textures shared with an earlier group are always published first
+	inline void collectLoadGroups() {
+		for (int group = assetLoader.nextGroup(); group >= 0 && assetLoader.ready(group); group = assetLoader.nextGroup()) {
+			finishLoadGroup(group);
+		}
+	}
+
+	// Makes a load group resident, blocking only if it is still loading
+	inline void requireLoadGroup(int group) {
+		if (assetLoader.finished(group)) {
+			return;
+		}
+		if (!assetLoader.ready(group)) {
+			std::cout << "Waiting for load group " << group << "\n";
+		}
+		while (!assetLoader.finished(group)) {
+			finishLoadGroup(assetLoader.nextGroup());
+		}
+	}
+
+	// Starts reading a loose asset file for the loader job that will open it (AssetFile::open),
+	// so that the reads of all the assets queued by localLoad() overlap. Packed assets are
+	// already mapped and are not read ahead
+	inline void prefetchAsset(const std::string& name) {
+		// packed assets are not read ahead, edited or not: the job opening them checks their
+		// loose file (editedSincePacked), off the main thread
+		std::string key = AssetPack::normalizeName(name);
+		if (fileReader.backend() == AsyncIO::BACKEND_NONE || mountedAssetPack().entries.count(key) != 0) {
+			return;
+		}
+		{
+			PrefetchTable& T = prefetchTable();
+			std::unique_lock<std::mutex> lock(T.mtx);
+			if (!T.files.emplace(key, PrefetchedFile()).second) {
+				return;
+			}
+		}
+		fileReader.read(name, [key](const std::string&, std::vector<unsigned char>& data, bool ok) {
+			PrefetchTable& T = prefetchTable();
+			std::unique_lock<std::mutex> lock(T.mtx);
+			auto it = T.files.find(key);
+			if (it != T.files.end()) {
+				it->second.data.swap(data);
+				it->second.ok = ok;
+				it->second.done = true;
+			}
+			T.readDone.notify_all();
+		});
+	}
+
+	// After the loader jobs: drops the files that were read ahead but never opened
+	inline void stopPrefetching() {
+		fileReader.stop();
+		PrefetchTable& T = prefetchTable();
+		std::unique_lock<std::mutex> lock(T.mtx);
+		T.files.clear();
+	}
+
+	// Registers a cooked texture whose image only holds the levels from tailLevel on
+	inline void startStreaming(const std::string& key, const std::string& cookedFile,
+		const Ktx2::Image& image, VkFormat format, uint32_t tailLevel) {
+		StreamedTexture& S = streamedTextures[key];
+		if (!S.file.open(cookedFile)) {
+			std::cout << "Cannot stream " << cookedFile << ", keeping its mip tail only\n";
+			streamedTextures.erase(key);
+			return;
+		}
+		S.image = image;
+		S.format = format;
+		S.tailLevel = S.residentLevel = S.plannedLevel = S.frameWanted = tailLevel;
+	}
+
+	// Bytes of the levels finer than the tail, from level on
+	static inline VkDeviceSize streamedBytes(const StreamedTexture& S, uint32_t level) {
+		VkDeviceSize bytes = 0;
+		for (uint32_t i = level; i < S.tailLevel; i++) {
+			bytes += S.image.levels[i].size;
+		}
+		return bytes;
+	}
+
+	// uvScale: the part of the image the pixels cover, for the tiles of an atlas
+	inline void requestTextureResolution(const std::string& key, float pixels, glm::vec2 uvScale = glm::vec2(1.0f)) {
+		auto it = streamedTextures.find(key);
+		if (it == streamedTextures.end() || !(pixels > 0.0f)) {
+			return;
+		}
+		StreamedTexture& S = it->second;
+		float ratio = std::max(S.image.width * uvScale.x, S.image.height * uvScale.y) / pixels;
+		uint32_t level = std::min(ratio > 1.0f ? (uint32_t)std::log2(ratio) : 0u, S.tailLevel);
+		if (S.lastNeeded != streamingFrame) {
+			S.lastNeeded = streamingFrame;
+			S.frameWanted = level;
+		}
+		else {
+			S.frameWanted = std::min(S.frameWanted, level);
+		}
+	}
+
+	// Called once per frame: takes the requests of the last frame, puts the results of the
+	// finished streaming job in place, or plans and starts the next one
+	inline void updateTextureStreaming() {
+		for (auto& E : streamedTextures) {
+			if (E.second.lastNeeded == streamingFrame) {
+				E.second.wantedLevel = E.second.frameWanted;
+			}
+		}
+		streamingFrame++;
+
+		if (streamingJob) {
+			if (!textureStreamer.ready(0)) {
+				return;
+			}
+			beginUploadBatch();
+			textureStreamer.finish(0);
+			endUploadBatch();
+			streamingJob = false;
+			streamingData.clear();
+			releasedStreams.clear();
+			applyTextureSwaps();
+			return;
+		}
+		planTextureStreaming();
+	}
+
+	// Chooses the finest level of every streamed texture: the most recently needed first, each
+	// down to the level it wants, evicting levels of less recently needed textures when the
+	// budget is exceeded. The changes are read by one background job
+	inline void planTextureStreaming() {
+		std::vector<StreamedTexture*> order;
+		VkDeviceSize used = 0;
+		for (auto& E : streamedTextures) {
+			E.second.plannedLevel = E.second.residentLevel;
+			used += streamedBytes(E.second, E.second.residentLevel);
+			order.push_back(&E.second);
+		}
+		std::stable_sort(order.begin(), order.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+			return a->lastNeeded != b->lastNeeded ? a->lastNeeded > b->lastNeeded : a->wantedLevel < b->wantedLevel;
+		});
+
+		for (size_t i = 0; i < order.size(); i++) {
+			StreamedTexture& S = *order[i];
+			if (S.wantedLevel >= S.plannedLevel) {
+				continue;
+			}
+			VkDeviceSize evictable = 0;
+			for (size_t j = i + 1; j < order.size(); j++) {
+				if (order[j]->lastNeeded < S.lastNeeded) {
+					evictable += streamedBytes(*order[j], order[j]->plannedLevel);
+				}
+			}
+			VkDeviceSize current = streamedBytes(S, S.plannedLevel);
+			uint32_t target = S.wantedLevel;
+			while (target < S.plannedLevel && used - current + streamedBytes(S, target) > textureBudget + evictable) {
+				target++;
+			}
+			if (target == S.plannedLevel) {
+				continue;
+			}
+			used += streamedBytes(S, target) - current;
+			S.plannedLevel = target;
+
+			// the order is by last use, so the least recently needed levels go first
+			for (size_t j = order.size() - 1; j > i && used > textureBudget; j--) {
+				StreamedTexture& V = *order[j];
+				if (V.lastNeeded >= S.lastNeeded) {
+					break;
+				}
+				while (V.plannedLevel < V.tailLevel && used > textureBudget) {
+					used -= V.image.levels[V.plannedLevel].size;
+					V.plannedLevel++;
+				}
+			}
+		}
+
+		streamingChanges.clear();
+		for (auto& E : streamedTextures) {
+			if (E.second.plannedLevel != E.second.residentLevel) {
+				streamingChanges.push_back({ E.first, E.second.plannedLevel });
+			}
+		}
+		if (streamingChanges.empty()) {
+			return;
+		}
+
+		// the worker only reads the mapped levels, the images are created on the main thread.
+		// Textures may be registered or released meanwhile: the worker does not look them up in
+		// the map, and releaseTexture() keeps the released ones alive (releasedStreams)
+		std::vector<const StreamedTexture*> sources;
+		for (const auto& C : streamingChanges) {
+			sources.push_back(&streamedTextures.at(C.first));
+		}
+		streamingData.assign(streamingChanges.size(), {});
+		streamingJob = true;
+		textureStreamer.submit([this, sources]() {
+			for (size_t i = 0; i < sources.size(); i++) {
+				const StreamedTexture& S = *sources[i];
+				for (uint32_t l = streamingChanges[i].second; l < S.image.levels.size(); l++) {
+					const unsigned char* level = S.file.data + S.image.levels[l].offset;
+					streamingData[i].insert(streamingData[i].end(), level, level + S.image.levels[l].size);
+				}
+			}
+		}, [this, sources]() {
+			for (size_t i = 0; i < streamingChanges.size(); i++) {
+				// skips the textures released during the job
+				auto it = streamedTextures.find(streamingChanges[i].first);
+				if (it != streamedTextures.end() && &it->second == sources[i]) {
+					createStreamedImage(it->first, it->second, streamingChanges[i].second, streamingData[i]);
+				}
+			}
+		});
+	}
+
+	// New image of a streamed texture, with the levels from level on, uploaded in the current batch
+	inline void createStreamedImage(const std::string& key, const StreamedTexture& S, uint32_t level,
+		const std::vector<unsigned char>& levels) {
+		TextureSwap T;
+		T.key = key;
+		T.level = level;
+		T.mipLevels = (uint32_t)S.image.levels.size() - level;
+
+		void* data;
+		VkBuffer stagingBuffer = stageUpload(levels.size(), data);
+		memcpy(data, levels.data(), levels.size());
+		std::vector<VkBufferImageCopy> regions;
+		VkDeviceSize offset = 0;
+		for (uint32_t i = 0; i < T.mipLevels; i++) {
+			const Ktx2::Level& L = S.image.levels[level + i];
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = i;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = S.image.faces;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { L.width, L.height, 1 };
+			regions.push_back(region);
+			offset += L.size;
+		}
+
+		const Ktx2::Level& L0 = S.image.levels[level];
+		createImage(L0.width, L0.height, T.mipLevels, S.image.faces, VK_SAMPLE_COUNT_1_BIT, S.format,
+			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, T.image, T.memory);
+		uploadImage(stagingBuffer, T.image, S.format, L0.width, L0.height, T.mipLevels, S.image.faces, regions);
+		T.view = createImageView(T.image, S.format, VK_IMAGE_ASPECT_COLOR_BIT, T.mipLevels,
+			VK_IMAGE_VIEW_TYPE_2D, S.image.faces);
+		textureSwaps.push_back(T);
+	}
+
+	// Puts the streamed images in place of the old ones in the textures. Descriptor sets cannot
+	// change under command buffers in flight: the old images are retired, and each swap chain
+	// image moves to the new ones in refreshSwapChainImage(), once its last frame is done
+	inline void applyTextureSwaps() {
+		if (textureSwaps.empty()) {
+			return;
+		}
+
+		std::set<Texture*> changed;
+		for (const TextureSwap& T : textureSwaps) {
+			RegisteredTexture& RT = textureRegistry.at(T.key);
+			StreamedTexture& S = streamedTextures.at(T.key);
+			retiredImages.push_back({ RT.image, RT.memory, RT.view, std::vector<bool>(commandBuffers.size(), true) });
+			RT.image = T.image;
+			RT.memory = T.memory;
+			RT.view = T.view;
+			RT.mipLevels = T.mipLevels;
+			for (Texture* U : RT.users) {
+				U->textureImage = T.image;
+				U->textureImageMemory = T.memory;
+				U->textureImageView = T.view;
+				U->mipLevels = T.mipLevels;
+				changed.insert(U);
+			}
+			std::cout << "[STREAM] " << T.key << ": level " << S.residentLevel << " -> " << T.level << "\n";
+			S.residentLevel = T.level;
+		}
+		textureSwaps.clear();
+		for (std::set<Texture*>& stale : staleTextures) {
+			stale.insert(changed.begin(), changed.end());
+		}
+
+		VkDeviceSize used = 0;
+		for (auto& E : streamedTextures) {
+			used += streamedBytes(E.second, E.second.residentLevel);
+		}
+		std::cout << "[STREAM] " << used / 1024 << " KB streamed, budget " << textureBudget / 1024 << " KB\n";
+	}
+
+	// Called when the command buffer of currentImage is not in flight: rewrites its descriptor
+	// sets that use streamed textures, records it again, and destroys the retired images no
+	// other swap chain image uses any more. Its last frame is done even when none of its sets
+	// changed, so it releases the retired images in any case
+	inline void refreshSwapChainImage(uint32_t currentImage) {
+		if (currentImage >= staleTextures.size()) {
+			return;
+		}
+		std::set<Texture*>& stale = staleTextures[currentImage];
+		if (!stale.empty()) {
+			bool rewritten = false;
+			for (DescriptorSet* DS : liveDescriptorSets) {
+				for (Texture* T : DS->textures) {
+					if (stale.count(T)) {
+						DS->updateTextures((int)currentImage);
+						rewritten = true;
+						break;
+					}
+				}
+			}
+			stale.clear();
+			if (rewritten) {
+				recordCommandBuffer(currentImage);
+			}
+		}
+
+		for (size_t i = 0; i < retiredImages.size(); ) {
+			RetiredImage& R = retiredImages[i];
+			R.pending[currentImage] = false;
+			if (std::find(R.pending.begin(), R.pending.end(), true) == R.pending.end()) {
+				vkDestroyImageView(device, R.view, nullptr);
+				vkDestroyImage(device, R.image, nullptr);
+				memoryAllocator.free(R.memory);
+				retiredImages.erase(retiredImages.begin() + i);
+			}
+			else {
+				i++;
+			}
+		}
+	}
+
+	// With the device idle: every command buffer is about to be recorded again
+	inline void destroyRetiredImages() {
+		for (RetiredImage& R : retiredImages) {
+			vkDestroyImageView(device, R.view, nullptr);
+			vkDestroyImage(device, R.image, nullptr);
+			memoryAllocator.free(R.memory);
+		}
+		retiredImages.clear();
+		staleTextures.clear();
+	}
+
+	inline void beginUploadBatch() {
+		batchingUploads = true;
+	}
+
+	inline void endUploadBatch() {
+		batchingUploads = false;
+		submitUploadBatch();
+	}
+
+	// Allocates and begins the command buffers of the current batch, if not done yet
+	inline void openUploadBatch() {
+		if (currentUpload.graphicsCommandBuffer != VK_NULL_HANDLE) {
+			return;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		VkResult result = vkAllocateCommandBuffers(device, &allocInfo, &currentUpload.graphicsCommandBuffer);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+		vkBeginCommandBuffer(currentUpload.graphicsCommandBuffer, &beginInfo);
+
+		if (transferQueueFamily == graphicsQueueFamily) {
+			currentUpload.transferCommandBuffer = currentUpload.graphicsCommandBuffer;
+			return;
+		}
+
+		allocInfo.commandPool = transferCommandPool;
+		result = vkAllocateCommandBuffers(device, &allocInfo, &currentUpload.transferCommandBuffer);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+		vkBeginCommandBuffer(currentUpload.transferCommandBuffer, &beginInfo);
+	}
+
+	// Submits the current batch: the copies on the transfer queue, which signals a semaphore the
+	// graphics submission waits on, and the blits and barriers on the graphics queue. Rendering
+	// submitted later on the graphics queue is ordered after them, so nothing waits on the CPU
+	inline void submitUploadBatch() {
+		UploadBatch& U = currentUpload;
+		if (U.graphicsCommandBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkResult result = vkCreateFence(device, &fenceInfo, nullptr, &U.fence);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create upload fence!");
+		}
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+
+		if (U.transferCommandBuffer != U.graphicsCommandBuffer) {
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			result = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &U.transferDone);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create upload semaphore!");
+			}
+
+			vkEndCommandBuffer(U.transferCommandBuffer);
+			submitInfo.pCommandBuffers = &U.transferCommandBuffer;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &U.transferDone;
+			result = vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to submit upload command buffer!");
+			}
+
+			submitInfo.signalSemaphoreCount = 0;
+			submitInfo.pSignalSemaphores = nullptr;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &U.transferDone;
+			submitInfo.pWaitDstStageMask = &waitStage;
+		}
+
+		vkEndCommandBuffer(U.graphicsCommandBuffer);
+		submitInfo.pCommandBuffers = &U.graphicsCommandBuffer;
+		result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, U.fence);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to submit upload command buffer!");
+		}
+
+		if (U.bufferCount + U.imageCount > 1) {
+			std::cout << "Upload batch: " << U.bufferCount << " buffers, " << U.imageCount << " images, "
+				<< U.stagedBytes / 1024 << " KB in one submission\n";
+		}
+		uploadsInFlight.push_back(U);
+		currentUpload = UploadBatch();
+	}
+
+	// Releases the staging buffers and command buffers of the completed batches;
+	// with wait, blocks until all of them have completed
+	inline void collectUploads(bool wait) {
+		for (size_t i = 0; i < uploadsInFlight.size(); ) {
+			UploadBatch& U = uploadsInFlight[i];
+			if (wait) {
+				vkWaitForFences(device, 1, &U.fence, VK_TRUE, UINT64_MAX);
+			}
+			else if (vkGetFenceStatus(device, U.fence) != VK_SUCCESS) {
+				i++;
+				continue;
+			}
+
+			for (auto& B : U.stagingBuffers) {
+				vkDestroyBuffer(device, B.first, nullptr);
+				memoryAllocator.free(B.second);
+			}
+			vkFreeCommandBuffers(device, commandPool, 1, &U.graphicsCommandBuffer);
+			if (U.transferCommandBuffer != U.graphicsCommandBuffer) {
+				vkFreeCommandBuffers(device, transferCommandPool, 1, &U.transferCommandBuffer);
+				vkDestroySemaphore(device, U.transferDone, nullptr);
+			}
+			vkDestroyFence(device, U.fence, nullptr);
+			uploadsInFlight.erase(uploadsInFlight.begin() + i);
+		}
+	}
+
+	inline void createDescriptorPool() {
 		std::array<VkDescriptorPoolSize, 2> poolSizes{};
 		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		poolSizes[0].descriptorCount = static_cast<uint32_t>(DPSZs.uniformBlocksInPool *
@@ -1538,44 +3444,50 @@ protected:
 			throw std::runtime_error("failed to allocate command buffers!");
 		}
 
+		staleTextures.assign(commandBuffers.size(), {});
 		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // Optional
-			beginInfo.pInheritanceInfo = nullptr; // Optional
+			recordCommandBuffer((uint32_t)i);
+		}
+	}
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
-				VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer!");
-			}
+	// Begins the command buffer anew: the pool resets it implicitly
+	inline void recordCommandBuffer(uint32_t i) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = 0; // Optional
+		beginInfo.pInheritanceInfo = nullptr; // Optional
 
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass;
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = swapChainExtent;
+		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
+			VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
 
-			std::array<VkClearValue, 2> clearValues{};
-			clearValues[0].color = initialBackgroundColor;
-			clearValues[1].depthStencil = { 1.0f, 0 };
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[i];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
 
-			renderPassInfo.clearValueCount =
-				static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = initialBackgroundColor;
+		clearValues[1].depthStencil = { 1.0f, 0 };
 
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
-				VK_SUBPASS_CONTENTS_INLINE);
+		renderPassInfo.clearValueCount =
+			static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
 
+		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
+			VK_SUBPASS_CONTENTS_INLINE);
 
-			populateCommandBuffer(commandBuffers[i], i);
 
+		populateCommandBuffer(commandBuffers[i], i);
 
-			vkCmdEndRenderPass(commandBuffers[i]);
 
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer!");
-			}
+		vkCmdEndRenderPass(commandBuffers[i]);
+
+		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
 		}
 	}
 
@@ -1620,6 +3532,10 @@ protected:
 	}
 
 	inline void drawFrame() {
+		collectUploads(false);
+		collectLoadGroups();
+		updateTextureStreaming();
+
 		vkWaitForFences(device, 1, &inFlightFences[currentFrame],
 			VK_TRUE, UINT64_MAX);
 
@@ -1641,8 +3557,10 @@ protected:
 				VK_TRUE, UINT64_MAX);
 		}
 		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+		refreshSwapChainImage(imageIndex);
 
 		updateUniformBuffer(imageIndex);
+		uniformRing.flush(imageIndex);
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1704,6 +3622,7 @@ protected:
 		}
 
 		vkDeviceWaitIdle(device);
+		destroyRetiredImages();
 
 		cleanupSwapChain();
 
@@ -1716,6 +3635,7 @@ protected:
 		createDescriptorPool();
 
 		pipelinesAndDescriptorSetsInit();
+		logPipelineCreation("swap chain recreation");
 
 		createCommandBuffers();
 	}
@@ -1723,11 +3643,11 @@ protected:
 	inline void cleanupSwapChain() {
 		vkDestroyImageView(device, colorImageView, nullptr);
 		vkDestroyImage(device, colorImage, nullptr);
-		vkFreeMemory(device, colorImageMemory, nullptr);
+		memoryAllocator.free(colorImageMemory);
 
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
+		memoryAllocator.free(depthImageMemory);
 
 		for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 			vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
@@ -1750,8 +3670,14 @@ protected:
 	}
 
 	inline void cleanup() {
+		assetLoader.stop();
+		textureStreamer.stop();
+		stopPrefetching();
+		collectUploads(true);
+		destroyRetiredImages();
 		cleanupSwapChain();
 
+		printResourceUsage(std::cout);
 		localCleanup();
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -1761,7 +3687,13 @@ protected:
 		}
 
 		vkDestroyCommandPool(device, commandPool, nullptr);
+		if (transferCommandPool != VK_NULL_HANDLE) {
+			vkDestroyCommandPool(device, transferCommandPool, nullptr);
+		}
 
+		savePipelineCache();
+		uniformRing.cleanup();
+		memoryAllocator.cleanup();
 		vkDestroyDevice(device, nullptr);
 
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
@@ -2137,18 +4069,11 @@ public:
 		}
 		// Create memory to back up the image
 		VkMemoryRequirements memRequirements;
-		VkMemoryAllocateInfo memAllocInfo(vks_initializers_memoryAllocateInfo());
-		VkDeviceMemory dstImageMemory;
 		vkGetImageMemoryRequirements(device, dstImage, &memRequirements);
-		memAllocInfo.allocationSize = memRequirements.size;
 		// Memory must be host visible to copy from
-		memAllocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		result = vkAllocateMemory(device, &memAllocInfo, nullptr, &dstImageMemory);
-		if (result != VK_SUCCESS) {
-			PrintVkError(result);
-			throw std::runtime_error("failed to create screenshot!!");
-		}
-		result = vkBindImageMemory(device, dstImage, dstImageMemory, 0);
+		Allocation dstImageMemory = memoryAllocator.allocate(memRequirements,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, RESOURCE_LINEAR);
+		result = vkBindImageMemory(device, dstImage, dstImageMemory.memory, dstImageMemory.offset);
 		if (result != VK_SUCCESS) {
 			PrintVkError(result);
 			throw std::runtime_error("failed to create screenshot!!");
@@ -2258,9 +4183,8 @@ public:
 		VkSubresourceLayout subResourceLayout;
 		vkGetImageSubresourceLayout(device, dstImage, &subResource, &subResourceLayout);
 
-		// Map image memory so we can start copying from it
-		const char* data;
-		vkMapMemory(device, dstImageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&data);
+		// The image memory is mapped by the allocator
+		const char* data = (const char*)dstImageMemory.mapped;
 		data += subResourceLayout.offset;
 
 		/*		std::ofstream file(filename, std::ios::out | std::ios::binary);
@@ -2340,8 +4264,7 @@ public:
 		std::cout << "Screenshot saved to disk" << std::endl;
 
 		// Clean up resources
-		vkUnmapMemory(device, dstImageMemory);
-		vkFreeMemory(device, dstImageMemory, nullptr);
+		memoryAllocator.free(dstImageMemory);
 		vkDestroyImage(device, dstImage, nullptr);
 
 		screenshotSaved = true;
@@ -2359,20 +4282,19 @@ inline void VertexDescriptor::init(BaseProject* bp, std::vector<VertexBindingDes
 	Bindings = B;
 	Layout = E;
 
-	Position.hasIt = false; Position.offset = 0;
-	Normal.hasIt = false; Normal.offset = 0;
-	UV.hasIt = false; UV.offset = 0;
-	Color.hasIt = false; Color.offset = 0;
-	Tangent.hasIt = false; Tangent.offset = 0;
+	Position = { false, 0, VK_FORMAT_UNDEFINED };
+	Normal = { false, 0, VK_FORMAT_UNDEFINED };
+	UV = { false, 0, VK_FORMAT_UNDEFINED };
+	Color = { false, 0, VK_FORMAT_UNDEFINED };
+	Tangent = { false, 0, VK_FORMAT_UNDEFINED };
 
 	if (B.size() == 1) {	// for now, read models only with every vertex information in a single binding
 		for (int i = 0; i < E.size(); i++) {
 			switch (E[i].usage) {
 			case VertexDescriptorElementUsage::POSITION:
-				if (E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
-					if (E[i].size == sizeof(glm::vec3)) {
-						Position.hasIt = true;
-						Position.offset = E[i].offset;
+				if (E[i].format == VK_FORMAT_R32G32B32_SFLOAT || E[i].format == VK_FORMAT_R16G16B16A16_SNORM) {
+					if (E[i].size == (E[i].format == VK_FORMAT_R32G32B32_SFLOAT ? sizeof(glm::vec3) : 4 * sizeof(int16_t))) {
+						Position = { true, E[i].offset, E[i].format };
 					}
 					else {
 						std::cout << "Vertex Position - wrong size\n";
@@ -2383,10 +4305,9 @@ inline void VertexDescriptor::init(BaseProject* bp, std::vector<VertexBindingDes
 				}
 				break;
 			case VertexDescriptorElementUsage::NORMAL:
-				if (E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
-					if (E[i].size == sizeof(glm::vec3)) {
-						Normal.hasIt = true;
-						Normal.offset = E[i].offset;
+				if (E[i].format == VK_FORMAT_R32G32B32_SFLOAT || E[i].format == VK_FORMAT_R16G16_SNORM) {
+					if (E[i].size == (E[i].format == VK_FORMAT_R32G32B32_SFLOAT ? sizeof(glm::vec3) : 2 * sizeof(int16_t))) {
+						Normal = { true, E[i].offset, E[i].format };
 					}
 					else {
 						std::cout << "Vertex Normal - wrong size\n";
@@ -2397,10 +4318,9 @@ inline void VertexDescriptor::init(BaseProject* bp, std::vector<VertexBindingDes
 				}
 				break;
 			case VertexDescriptorElementUsage::UV:
-				if (E[i].format == VK_FORMAT_R32G32_SFLOAT) {
-					if (E[i].size == sizeof(glm::vec2)) {
-						UV.hasIt = true;
-						UV.offset = E[i].offset;
+				if (E[i].format == VK_FORMAT_R32G32_SFLOAT || E[i].format == VK_FORMAT_R16G16_UNORM) {
+					if (E[i].size == (E[i].format == VK_FORMAT_R32G32_SFLOAT ? sizeof(glm::vec2) : 2 * sizeof(uint16_t))) {
+						UV = { true, E[i].offset, E[i].format };
 					}
 					else {
 						std::cout << "Vertex UV - wrong size\n";
@@ -2413,8 +4333,7 @@ inline void VertexDescriptor::init(BaseProject* bp, std::vector<VertexBindingDes
 			case VertexDescriptorElementUsage::COLOR:
 				if (E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
 					if (E[i].size == sizeof(glm::vec3)) {
-						Color.hasIt = true;
-						Color.offset = E[i].offset;
+						Color = { true, E[i].offset, E[i].format };
 					}
 					else {
 						std::cout << "Vertex Color - wrong size\n";
@@ -2427,8 +4346,7 @@ inline void VertexDescriptor::init(BaseProject* bp, std::vector<VertexBindingDes
 			case VertexDescriptorElementUsage::TANGENT:
 				if (E[i].format == VK_FORMAT_R32G32B32A32_SFLOAT) {
 					if (E[i].size == sizeof(glm::vec4)) {
-						Tangent.hasIt = true;
-						Tangent.offset = E[i].offset;
+						Tangent = { true, E[i].offset, E[i].format };
 					}
 					else {
 						std::cout << "Vertex Tangent - wrong size\n";
@@ -2451,6 +4369,47 @@ inline void VertexDescriptor::init(BaseProject* bp, std::vector<VertexBindingDes
 inline void VertexDescriptor::cleanup() {
 }
 
+inline uint64_t VertexDescriptor::layoutHash() {
+	uint64_t h = hashBytes(nullptr, 0);
+	for (int i = 0; i < Bindings.size(); i++) {
+		uint32_t v[] = { Bindings[i].binding, Bindings[i].stride, (uint32_t)Bindings[i].inputRate };
+		h = hashBytes(v, sizeof(v), h);
+	}
+	for (int i = 0; i < Layout.size(); i++) {
+		uint32_t v[] = { Layout[i].binding, Layout[i].location, (uint32_t)Layout[i].format,
+						 Layout[i].offset, Layout[i].size, (uint32_t)Layout[i].usage };
+		h = hashBytes(v, sizeof(v), h);
+	}
+	return h;
+}
+
+inline bool VertexDescriptor::quantized() {
+	return (Position.hasIt && Position.format != VK_FORMAT_R32G32B32_SFLOAT) ||
+		(Normal.hasIt && Normal.format != VK_FORMAT_R32G32B32_SFLOAT) ||
+		(UV.hasIt && UV.format != VK_FORMAT_R32G32_SFLOAT);
+}
+
+// The same components, all in float formats and packed in a single binding
+inline VertexDescriptor VertexDescriptor::floatLayout() {
+	std::vector<VertexDescriptorElement> E;
+	uint32_t offset = 0;
+	auto add = [&](const VertexComponent& C, VkFormat format, uint32_t size, VertexDescriptorElementUsage usage) {
+		if (C.hasIt) {
+			E.push_back({ 0, (uint32_t)E.size(), format, offset, size, usage });
+			offset += size;
+		}
+	};
+	add(Position, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::vec3), VertexDescriptorElementUsage::POSITION);
+	add(Normal, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::vec3), VertexDescriptorElementUsage::NORMAL);
+	add(UV, VK_FORMAT_R32G32_SFLOAT, sizeof(glm::vec2), VertexDescriptorElementUsage::UV);
+	add(Color, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::vec3), VertexDescriptorElementUsage::COLOR);
+	add(Tangent, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(glm::vec4), VertexDescriptorElementUsage::TANGENT);
+
+	VertexDescriptor F;
+	F.init(BP, { { 0, offset, Bindings[0].inputRate } }, E);
+	return F;
+}
+
 inline std::vector<VkVertexInputBindingDescription> VertexDescriptor::getBindingDescription() {
 	std::vector<VkVertexInputBindingDescription>bindingDescription{};
 	bindingDescription.resize(Bindings.size());
@@ -2476,71 +4435,57 @@ inline std::vector<VkVertexInputAttributeDescription> VertexDescriptor::getAttri
 }
 
 inline void Model::loadModelOBJ(std::string file) {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
-
 	std::cout << "Loading : " << file << "[OBJ]\n";
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-		file.c_str())) {
-		throw std::runtime_error(warn + err);
+	AssetFile source;
+	if (!source.open(file)) {
+		std::cout << "Failed to open: " << file << "\n";
+		throw std::runtime_error("failed to open file!");
 	}
 
-	//	std::cout << "Building\n";	
-	//	std::cout << "Position " << VD->Position.hasIt << "," << VD->Position.offset << "\n";	
-	//	std::cout << "UV " << VD->UV.hasIt << "," << VD->UV.offset << "\n";	
-	//	std::cout << "Normal " << VD->Normal.hasIt << "," << VD->Normal.offset << "\n";
-	int mainStride = VD->Bindings[0].stride;
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			std::vector<unsigned char> vertex(mainStride, 0);
-			glm::vec3 pos = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
-			if (VD->Position.hasIt) {
-				glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + VD->Position.offset);
-				*o = pos;
-			}
+	int mainStride = LD->Bindings[0].stride;
+	ObjVertexLayout L;
+	L.stride = mainStride;
+	L.positionOffset = LD->Position.hasIt ? (int)LD->Position.offset : -1;
+	L.normalOffset = LD->Normal.hasIt ? (int)LD->Normal.offset : -1;
+	L.uvOffset = LD->UV.hasIt ? (int)LD->UV.offset : -1;
+	L.colorOffset = LD->Color.hasIt ? (int)LD->Color.offset : -1;
 
-			glm::vec3 color = {
-				attrib.colors[3 * index.vertex_index + 0],
-				attrib.colors[3 * index.vertex_index + 1],
-				attrib.colors[3 * index.vertex_index + 2]
-			};
-			if (VD->Color.hasIt) {
-				glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + VD->Color.offset);
-				*o = color;
-			}
+	// Corners whose bytes match for every attribute of the layout are welded into one vertex
+	size_t corners = ObjParser::parse((const char*)source.data, source.size, L, vertices, indices);
 
-			glm::vec2 texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1 - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
-			if (VD->UV.hasIt) {
-				glm::vec2* o = (glm::vec2*)((char*)(&vertex[0]) + VD->UV.offset);
-				*o = texCoord;
-			}
+	std::cout << "[OBJ] Vertices: " << (vertices.size() / mainStride)
+		<< " (welded from " << corners << ")";
+	std::cout << " Indices: " << indices.size() << "\n";
 
-			glm::vec3 norm = {
-				attrib.normals[3 * index.normal_index + 0],
-				attrib.normals[3 * index.normal_index + 1],
-				attrib.normals[3 * index.normal_index + 2]
-			};
-			if (VD->Normal.hasIt) {
-				glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + VD->Normal.offset);
-				*o = norm;
-			}
+}
 
-			vertices.insert(vertices.end(), vertex.begin(), vertex.end());
-			indices.push_back((vertices.size() / mainStride) - 1);
-		}
+// MGCG models are AES-128-CBC encrypted: a 16-byte ASCII header with the inflated size,
+// followed by a deflate stream
+static const size_t MGCG_HEADER_SIZE = 16;
+static const size_t MGCG_CHUNK_SIZE = 64 * 1024;
+
+// Decrypts data into out one chunk at a time, each chunk chaining from the last cipher block of
+// the previous one. The PKCS padding, when valid, is left out of the returned size.
+inline size_t decryptMGCG(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+	const std::vector<unsigned char> key = plusaes::key_from_string(&"CG2023SkelKey128"); // 16-char = 128-bit
+	unsigned char iv[16] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+		0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+	};
+
+	if (size < MGCG_HEADER_SIZE || size % 16 != 0) {
+		throw std::runtime_error("malformed MGCG file!");
+	}
+	out.resize(size);
+	for (size_t offset = 0; offset < size; offset += MGCG_CHUNK_SIZE) {
+		size_t chunk = std::min(MGCG_CHUNK_SIZE, size - offset);
+		plusaes::decrypt_cbc(data + offset, (unsigned long)chunk, &key[0], (unsigned long)key.size(),
+			&iv, &out[offset], (unsigned long)chunk, nullptr);
+		memcpy(iv, data + offset + chunk - 16, 16);
 	}
-	std::cout << "[OBJ] Vertices: " << (vertices.size() / mainStride);
-	std::cout << " Indices: " << indices.size() << "\n";
 
+	size_t padding = out[size - 1];
+	return padding >= 1 && padding <= 16 ? size - padding : size;
 }
 
 inline void Model::loadModelGLTF(std::string file, bool encoded) {
@@ -2548,44 +4493,52 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 	tinygltf::TinyGLTF loader;
 	std::string warn, err;
 
-	int mainStride = VD->Bindings[0].stride;
+	int mainStride = LD->Bindings[0].stride;
 
 	std::cout << "Loading : " << file << (encoded ? "[MGCG]" : "[GLTF]") << "\n";
 	if (encoded) {
-		auto modelString = readFile(file);
-
-		const std::vector<unsigned char> key = plusaes::key_from_string(&"CG2023SkelKey128"); // 16-char = 128-bit
-		const unsigned char iv[16] = {
-			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-			0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
-		};
-
-		// decrypt
-		unsigned long padded_size = 0;
-		std::vector<unsigned char> decrypted(modelString.size());
-
-		plusaes::decrypt_cbc((unsigned char*)modelString.data(), modelString.size(), &key[0], key.size(), &iv, &decrypted[0], decrypted.size(), &padded_size);
+		// Reused by every model decoded on the same asset loader thread
+		static thread_local std::vector<unsigned char> decrypted;
+		static thread_local std::vector<unsigned char> inflated;
+
+		AssetFile source;
+		if (!source.open(file)) {
+			std::cout << "Failed to open: " << file << "\n";
+			throw std::runtime_error("failed to open file!");
+		}
+		size_t decryptedSize = decryptMGCG(source.data, source.size, decrypted);
+		source.close();
 
+		char header[MGCG_HEADER_SIZE + 1] = {};
+		memcpy(header, decrypted.data(), MGCG_HEADER_SIZE);
 		int size = 0;
-		void* decomp;
-
-		sscanf(reinterpret_cast<char* const>(&decrypted[0]), "%d", &size);
-		//std::cout << decrypted.size() << ", decomp: " << size << "\n";
-		//for(int i=0;i<32;i++) {
-		//	std::cout << (int)decrypted[i] << "\n";
-		//}
+		sscanf(header, "%d", &size);
+		if (size <= 0) {
+			throw std::runtime_error("malformed MGCG file!");
+		}
 
-		decomp = calloc(size, 1);
-		int n = sinflate(decomp, (int)size, &decrypted[16], decrypted.size() - 16);
+		// sinfl has no streaming interface: the deflate stream is inflated in a single call
+		inflated.resize(size);
+		int n = sinflate(inflated.data(), size, &decrypted[MGCG_HEADER_SIZE], (int)(decryptedSize - MGCG_HEADER_SIZE));
+		if (n != size) {
+			throw std::runtime_error("failed to inflate MGCG file!");
+		}
 
 		if (!loader.LoadASCIIFromString(&model, &warn, &err,
-			reinterpret_cast<const char*>(decomp), size, "/")) {
+			reinterpret_cast<const char*>(inflated.data()), size, "/")) {
 			throw std::runtime_error(warn + err);
 		}
 	}
 	else {
-		if (!loader.LoadASCIIFromFile(&model, &warn, &err,
-			file.c_str())) {
+		AssetFile source;
+		if (!source.open(file)) {
+			std::cout << "Failed to open: " << file << "\n";
+			throw std::runtime_error("failed to open file!");
+		}
+		// external buffers and images are still resolved next to the loose file
+		std::string baseDir = std::filesystem::path(file).parent_path().string();
+		if (!loader.LoadASCIIFromString(&model, &warn, &err,
+			reinterpret_cast<const char*>(source.data), (unsigned int)source.size, baseDir)) {
 			throw std::runtime_error(warn + err);
 		}
 	}
@@ -2623,7 +4576,7 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 				if (cntPos > cntTot) cntTot = cntPos;
 			}
 			else {
-				if (VD->Position.hasIt) {
+				if (LD->Position.hasIt) {
 					std::cout << "Warning: vertex layout has position, but file hasn't\n";
 				}
 			}
@@ -2638,7 +4591,7 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 				if (cntNorm > cntTot) cntTot = cntNorm;
 			}
 			else {
-				if (VD->Normal.hasIt) {
+				if (LD->Normal.hasIt) {
 					std::cout << "Warning: vertex layout has normal, but file hasn't\n";
 				}
 			}
@@ -2653,7 +4606,7 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 				if (cntTan > cntTot) cntTot = cntTan;
 			}
 			else {
-				if (VD->Tangent.hasIt) {
+				if (LD->Tangent.hasIt) {
 					std::cout << "Warning: vertex layout has tangent, but file hasn't\n";
 				}
 			}
@@ -2668,7 +4621,7 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 				if (cntUV > cntTot) cntTot = cntUV;
 			}
 			else {
-				if (VD->UV.hasIt) {
+				if (LD->UV.hasIt) {
 					std::cout << "Warning: vertex layout has UV, but file hasn't\n";
 				}
 			}
@@ -2679,48 +4632,48 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 				//std::cout << vertices.size() << "," << vertex.size() << "," << &vertex << " " << &vertex[0] << " ";
 				//std::cout << i << "\n";
 
-				if ((i < cntPos) && meshHasPos && VD->Position.hasIt) {
+				if ((i < cntPos) && meshHasPos && LD->Position.hasIt) {
 					glm::vec3 pos = {
 						bufferPos[3 * i + 0],
 						bufferPos[3 * i + 1],
 						bufferPos[3 * i + 2]
 					};
-					//std::cout << "Pos: " <<	VD->Position.offset << "\n";
-					glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + VD->Position.offset);
+					//std::cout << "Pos: " <<	LD->Position.offset << "\n";
+					glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + LD->Position.offset);
 					//std::cout << "at: " << o << "\n";
 					*o = pos;
 					//std::cout << "Copied: " << o->x << "\n";
 				}
-				if ((i < cntNorm) && meshHasNorm && VD->Normal.hasIt) {
+				if ((i < cntNorm) && meshHasNorm && LD->Normal.hasIt) {
 					glm::vec3 normal = {
 						bufferNormals[3 * i + 0],
 						bufferNormals[3 * i + 1],
 						bufferNormals[3 * i + 2]
 					};
-					//std::cout << "Nor: " <<	VD->Normal.offset << "\n";
-					glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + VD->Normal.offset);
+					//std::cout << "Nor: " <<	LD->Normal.offset << "\n";
+					glm::vec3* o = (glm::vec3*)((char*)(&vertex[0]) + LD->Normal.offset);
 					*o = normal;
 				}
 
-				if ((i < cntTan) && meshHasTan && VD->Tangent.hasIt) {
+				if ((i < cntTan) && meshHasTan && LD->Tangent.hasIt) {
 					glm::vec4 tangent = {
 						bufferTangents[4 * i + 0],
 						bufferTangents[4 * i + 1],
 						bufferTangents[4 * i + 2],
 						bufferTangents[4 * i + 3]
 					};
-					//std::cout << "Tan: " <<	VD->Tangent.offset << "\n";
-					glm::vec4* o = (glm::vec4*)((char*)(&vertex[0]) + VD->Tangent.offset);
+					//std::cout << "Tan: " <<	LD->Tangent.offset << "\n";
+					glm::vec4* o = (glm::vec4*)((char*)(&vertex[0]) + LD->Tangent.offset);
 					*o = tangent;
 				}
 
-				if ((i < cntUV) && meshHasUV && VD->UV.hasIt) {
+				if ((i < cntUV) && meshHasUV && LD->UV.hasIt) {
 					glm::vec2 texCoord = {
 						bufferTexCoords[2 * i + 0],
 						bufferTexCoords[2 * i + 1]
 					};
-					//std::cout << "UV : " <<	VD->UV.offset << "\n";
-					glm::vec2* o = (glm::vec2*)((char*)(&vertex[0]) + VD->UV.offset);
+					//std::cout << "UV : " <<	LD->UV.offset << "\n";
+					glm::vec2* o = (glm::vec2*)((char*)(&vertex[0]) + LD->UV.offset);
 					*o = texCoord;
 				}
 
@@ -2795,78 +4748,566 @@ inline void Model::loadModelGLTF(std::string file, bool encoded) {
 	else {
 		S = glm::vec3(1);
 	}
-	//printVec3("T",T);
-	//printQuat("Q",Q);
-	//printVec3("S",S);
-	Wm = glm::translate(glm::mat4(1), T) *
-		glm::mat4(Q) *
-		glm::scale(glm::mat4(1), S);
+	//printVec3("T",T);
+	//printQuat("Q",Q);
+	//printVec3("S",S);
+	Wm = glm::translate(glm::mat4(1), T) *
+		glm::mat4(Q) *
+		glm::scale(glm::mat4(1), S);
+}
+
+inline void Model::createVertexBuffer() {
+	//	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	VkDeviceSize bufferSize = vertices.size();
+	vertexCount = (uint32_t)(vertices.size() / VD->Bindings[0].stride);
+
+	if (!hostVisible) {
+		BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			vertexBuffer, vertexBufferMemory);
+		BP->uploadBuffer(vertexBuffer, vertices.data(), bufferSize);
+		return;
+	}
+
+	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		vertexBuffer, vertexBufferMemory);
+
+	memcpy(vertexBufferMemory.mapped, vertices.data(), (size_t)bufferSize);
+}
+
+inline void Model::createIndexBuffer() {
+	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	indexCount = lods.empty() ? (uint32_t)indices.size() : lods[0].indexCount;
+
+	if (!hostVisible) {
+		// 16-bit indices when every vertex can be addressed with them;
+		// host-visible meshes keep 32 bits, so that the CPU can rewrite them in place
+		std::vector<uint16_t> narrow;
+		const void* data = indices.data();
+		indexType = VK_INDEX_TYPE_UINT32;
+		if (vertices.size() / VD->Bindings[0].stride <= 65536) {
+			narrow.assign(indices.begin(), indices.end());
+			data = narrow.data();
+			bufferSize = sizeof(narrow[0]) * narrow.size();
+			indexType = VK_INDEX_TYPE_UINT16;
+		}
+		BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			indexBuffer, indexBufferMemory);
+		BP->uploadBuffer(indexBuffer, data, bufferSize);
+		return;
+	}
+	indexType = VK_INDEX_TYPE_UINT32;
+
+	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		indexBuffer, indexBufferMemory);
+
+	memcpy(indexBufferMemory.mapped, indices.data(), (size_t)bufferSize);
+}
+
+inline void Model::initMesh(BaseProject* bp, VertexDescriptor* vd) {
+	BP = bp;
+	VD = vd;
+	if (name.empty()) {
+		name = "[mesh]";
+	}
+	BP->liveModels.insert(this);
+	int mainStride = VD->Bindings[0].stride;
+	lods = { { 0, (uint32_t)indices.size(), 0.0f } };
+	std::cout << "[Manual] Vertices: " << (vertices.size() / mainStride)
+		<< " Indices: " << indices.size() << "\n";
+	createVertexBuffer();
+	createIndexBuffer();
+	Wm = glm::mat4(1);
+	Qm = glm::mat4(1);
+	applyResidency();
+}
+
+// Releases the host copies not asked for by residency. The buffers must have been created:
+// the uploads copy the data to staging memory right away, so it can go as soon as they return
+inline void Model::applyResidency() {
+	if (hostVisible || residency == RESIDENCY_FULL) {
+		return;
+	}
+	if (residency == RESIDENCY_POSITIONS && VD->Position.hasIt) {
+		size_t stride = VD->Bindings[0].stride;
+		positions.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			const unsigned char* src = vertices.data() + v * stride + VD->Position.offset;
+			if (VD->Position.format == VK_FORMAT_R16G16B16A16_SNORM) {
+				int16_t q[3];
+				memcpy(q, src, sizeof(q));
+				glm::vec3 p = glm::max(glm::vec3(q[0], q[1], q[2]) / 32767.0f, glm::vec3(-1.0f));
+				positions[v] = glm::vec3(Qm * glm::vec4(p, 1.0f));
+			}
+			else {
+				memcpy(&positions[v], src, sizeof(glm::vec3));
+			}
+		}
+		indices.resize(indexCount);
+		indices.shrink_to_fit();
+	}
+	else {
+		std::vector<uint32_t>().swap(indices);
+	}
+	std::vector<unsigned char>().swap(vertices);
+}
+
+inline bool Model::loadCache(const std::string& cacheFile, uint64_t sourceHash, ModelType MT, bool allowPacked) {
+	AssetFile cache;
+	if (!cache.open(cacheFile, allowPacked) || cache.size < sizeof(ModelCacheHeader)) {
+		return false;
+	}
+
+	ModelCacheHeader H;
+	memcpy(&H, cache.data, sizeof(H));
+	if (memcmp(H.magic, "MGCC", 4) != 0 || H.version != MODEL_CACHE_VERSION ||
+		H.modelType != (uint32_t)MT || H.sourceHash != sourceHash ||
+		H.stride != VD->Bindings[0].stride || H.layoutHash != VD->layoutHash() ||
+		H.optimized != (uint32_t)optimizeMesh || H.lodLevels != lodLevels) {
+		return false;
+	}
+	size_t payload = cache.size - sizeof(H);
+	if (H.vertexBytes > payload ||
+		H.indexCount != (payload - H.vertexBytes) / sizeof(uint32_t) ||
+		(payload - H.vertexBytes) % sizeof(uint32_t) != 0 ||
+		H.lodCount == 0 || H.lodCount > MODEL_MAX_LODS) {
+		std::cout << "Corrupted mesh cache: " << cacheFile << "\n";
+		return false;
+	}
+	for (uint32_t i = 0; i < H.lodCount; i++) {
+		if ((uint64_t)H.lods[i].firstIndex + H.lods[i].indexCount > H.indexCount) {
+			std::cout << "Corrupted mesh cache: " << cacheFile << "\n";
+			return false;
+		}
+	}
+
+	const unsigned char* ptr = cache.data + sizeof(H);
+	vertices.assign(ptr, ptr + H.vertexBytes);
+	indices.resize(H.indexCount);
+	memcpy(indices.data(), ptr + H.vertexBytes, H.indexCount * sizeof(uint32_t));
+	memcpy(&Wm[0][0], H.Wm, sizeof(H.Wm));
+	memcpy(&Qm[0][0], H.Qm, sizeof(H.Qm));
+	lods.assign(H.lods, H.lods + H.lodCount);
+	boundsCenter = glm::vec3(H.boundsCenter[0], H.boundsCenter[1], H.boundsCenter[2]);
+	boundsRadius = H.boundsRadius;
+
+	std::cout << "Loading : " << cacheFile << (cache.packed ? "[PACKED CACHE]\n" : "[CACHE]\n");
+	std::cout << "[CACHE] Vertices: " << (vertices.size() / H.stride)
+		<< " Indices: " << indices.size() << "\n";
+	return true;
+}
+
+inline void Model::saveCache(const std::string& cacheFile, uint64_t sourceHash, ModelType MT) {
+	ModelCacheHeader H{};
+	memcpy(H.magic, "MGCC", 4);
+	H.version = MODEL_CACHE_VERSION;
+	H.modelType = (uint32_t)MT;
+	H.stride = VD->Bindings[0].stride;
+	H.optimized = optimizeMesh;
+	H.lodLevels = lodLevels;
+	H.lodCount = (uint32_t)lods.size();
+	std::copy(lods.begin(), lods.end(), H.lods);
+	memcpy(H.boundsCenter, &boundsCenter[0], sizeof(H.boundsCenter));
+	H.boundsRadius = boundsRadius;
+	H.layoutHash = VD->layoutHash();
+	H.sourceHash = sourceHash;
+	H.vertexBytes = vertices.size();
+	H.indexCount = indices.size();
+	memcpy(H.Wm, &Wm[0][0], sizeof(H.Wm));
+	memcpy(H.Qm, &Qm[0][0], sizeof(H.Qm));
+
+	// written to a temporary file first, so an interrupted run never leaves a truncated cache behind
+	std::string tmpFile = cacheFile + ".tmp";
+	std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cout << "Could not write mesh cache: " << cacheFile << "\n";
+		return;
+	}
+	out.write((const char*)&H, sizeof(H));
+	out.write((const char*)vertices.data(), vertices.size());
+	out.write((const char*)indices.data(), indices.size() * sizeof(uint32_t));
+	out.close();
+	if (!out) {
+		std::remove(tmpFile.c_str());
+		std::cout << "Could not write mesh cache: " << cacheFile << "\n";
+		return;
+	}
+	std::remove(cacheFile.c_str());
+	if (std::rename(tmpFile.c_str(), cacheFile.c_str()) != 0) {
+		std::remove(tmpFile.c_str());
+		std::cout << "Could not write mesh cache: " << cacheFile << "\n";
+	}
+}
+
+// Bounds of the mesh, and the simplified levels of detail appended to indices
+inline void Model::generateLods() {
+	size_t stride = LD->Bindings[0].stride;
+	size_t vertexCount = vertices.size() / stride;
+	lods = { { 0, (uint32_t)indices.size(), 0.0f } };
+	if (!LD->Position.hasIt || vertexCount == 0) {
+		return;
+	}
+
+	std::vector<float> positions(vertexCount * 3);
+	glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+	for (size_t v = 0; v < vertexCount; v++) {
+		glm::vec3 p;
+		memcpy(&p, vertices.data() + v * stride + LD->Position.offset, sizeof(p));
+		memcpy(&positions[v * 3], &p, sizeof(p));
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+	boundsCenter = (lo + hi) * 0.5f;
+	boundsRadius = 0.0f;
+	for (size_t v = 0; v < vertexCount; v++) {
+		boundsRadius = std::max(boundsRadius, glm::length(glm::vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]) - boundsCenter));
+	}
+	if (lodLevels == 0) {
+		return;
+	}
+
+	// Normals and UVs pick the vertex a collapsed corner moves to
+	size_t attributeStride = (LD->Normal.hasIt ? 3 : 0) + (LD->UV.hasIt ? 2 : 0);
+	std::vector<float> attributes(vertexCount * attributeStride);
+	for (size_t v = 0; v < vertexCount && attributeStride > 0; v++) {
+		float* a = &attributes[v * attributeStride];
+		if (LD->Normal.hasIt) {
+			memcpy(a, vertices.data() + v * stride + LD->Normal.offset, sizeof(glm::vec3));
+			a += 3;
+		}
+		if (LD->UV.hasIt) {
+			memcpy(a, vertices.data() + v * stride + LD->UV.offset, sizeof(glm::vec2));
+		}
+	}
+
+	std::vector<uint32_t> current = indices;
+	float error = 0.0f;
+	std::cout << "[LOD] Triangles: " << current.size() / 3;
+	for (uint32_t level = 1; level <= lodLevels && level < MODEL_MAX_LODS; level++) {
+		float levelError;
+		std::vector<uint32_t> next = MeshOptimizer::simplify(current, positions, vertexCount,
+			attributes, attributeStride, current.size() / 2, levelError);
+		// stop when the simplifier gets stuck on borders and seams
+		if (next.empty() || next.size() > current.size() * 4 / 5) {
+			break;
+		}
+		error += levelError;
+		lods.push_back({ (uint32_t)indices.size(), (uint32_t)next.size(), error });
+		indices.insert(indices.end(), next.begin(), next.end());
+		current.swap(next);
+		std::cout << " -> " << current.size() / 3;
+	}
+	std::cout << "\n";
+}
+
+inline void Model::optimize() {
+	size_t stride = LD->Bindings[0].stride;
+	size_t vertexCount = vertices.size() / stride;
+	if (indices.size() < 3 || vertexCount == 0) {
+		return;
+	}
+	auto lodIndices = [this](const ModelLod& L) {
+		return std::vector<uint32_t>(indices.begin() + L.firstIndex, indices.begin() + L.firstIndex + L.indexCount);
+	};
+	MeshOptimizer::CacheStats before = MeshOptimizer::analyzeVertexCache(lodIndices(lods[0]), vertexCount);
+
+	std::vector<float> positions;
+	if (LD->Position.hasIt) {
+		positions.resize(vertexCount * 3);
+		for (size_t v = 0; v < vertexCount; v++) {
+			memcpy(&positions[v * 3], vertices.data() + v * stride + LD->Position.offset, 3 * sizeof(float));
+		}
+	}
+	// Triangles are reordered within each level, vertices once for all of them
+	for (const ModelLod& L : lods) {
+		std::vector<uint32_t> range = lodIndices(L);
+		MeshOptimizer::optimizeVertexCache(range, vertexCount);
+		if (LD->Position.hasIt) {
+			MeshOptimizer::optimizeOverdraw(range, positions, vertexCount);
+		}
+		std::copy(range.begin(), range.end(), indices.begin() + L.firstIndex);
+	}
+	vertexCount = MeshOptimizer::optimizeVertexFetch(vertices, stride, indices);
+
+	MeshOptimizer::CacheStats after = MeshOptimizer::analyzeVertexCache(lodIndices(lods[0]), vertexCount);
+	std::cout << "[Opt] ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+}
+
+inline int16_t packSnorm16(float v) {
+	return (int16_t)std::round(std::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+inline uint16_t packUnorm16(float v) {
+	return (uint16_t)std::round(std::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
+
+// Octahedral encoding: the unit sphere projected on the octahedron |x|+|y|+|z| = 1,
+// whose lower half is folded over the upper one. Decoded by octDecode() in the vertex shaders.
+inline glm::vec2 octEncode(glm::vec3 n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (l1 == 0.0f) {
+		return glm::vec2(0.0f);
+	}
+	glm::vec2 e = glm::vec2(n.x, n.y) / l1;
+	if (n.z < 0.0f) {
+		e = glm::vec2((1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return e;
+}
+
+// Moves the UVs into the atlas tile of the texture (uvScaleOffset). They are clamped to [0,1]
+// first, so that they never reach the neighbors of the tile
+inline void Model::applyUvScaleOffset() {
+	if (!LD->UV.hasIt || uvScaleOffset == glm::vec4(1.0f, 1.0f, 0.0f, 0.0f)) {
+		return;
+	}
+	size_t stride = LD->Bindings[0].stride;
+	size_t vertexCount = vertices.size() / stride;
+	size_t clamped = 0;
+	for (size_t v = 0; v < vertexCount; v++) {
+		unsigned char* p = vertices.data() + v * stride + LD->UV.offset;
+		glm::vec2 uv;
+		memcpy(&uv, p, sizeof(uv));
+		glm::vec2 c = glm::clamp(uv, glm::vec2(0.0f), glm::vec2(1.0f));
+		clamped += c != uv;
+		uv = c * glm::vec2(uvScaleOffset.x, uvScaleOffset.y) + glm::vec2(uvScaleOffset.z, uvScaleOffset.w);
+		memcpy(p, &uv, sizeof(uv));
+	}
+	if (clamped > 0) {
+		std::cout << "Warning: " << clamped << " UVs outside [0,1] clamped to the atlas tile\n";
+	}
 }
 
-inline void Model::createVertexBuffer() {
-	//	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-	VkDeviceSize bufferSize = vertices.size();
+// Converts vertices from the float layout LD to the compact layout VD. Positions are stored
+// relative to the bounding box of the mesh, which Qm maps back to model space.
+inline void Model::quantize() {
+	size_t srcStride = LD->Bindings[0].stride;
+	size_t dstStride = VD->Bindings[0].stride;
+	size_t vertexCount = vertices.size() / srcStride;
+
+	glm::vec3 center(0.0f), extent(1.0f);
+	if (vertexCount > 0 && VD->Position.hasIt) {
+		glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+		for (size_t v = 0; v < vertexCount; v++) {
+			glm::vec3 p;
+			memcpy(&p, vertices.data() + v * srcStride + LD->Position.offset, sizeof(p));
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		center = (lo + hi) * 0.5f;
+		extent = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
+	}
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBuffer, vertexBufferMemory);
+	std::vector<unsigned char> packed(vertexCount * dstStride, 0);
+	size_t clampedUV = 0;
+	for (size_t v = 0; v < vertexCount; v++) {
+		const unsigned char* src = vertices.data() + v * srcStride;
+		unsigned char* dst = packed.data() + v * dstStride;
+
+		if (VD->Position.hasIt) {
+			glm::vec3 p;
+			memcpy(&p, src + LD->Position.offset, sizeof(p));
+			if (VD->Position.format == VK_FORMAT_R16G16B16A16_SNORM) {
+				glm::vec3 q = (p - center) / extent;
+				int16_t o[4] = { packSnorm16(q.x), packSnorm16(q.y), packSnorm16(q.z), 32767 };
+				memcpy(dst + VD->Position.offset, o, sizeof(o));
+			}
+			else {
+				memcpy(dst + VD->Position.offset, &p, sizeof(p));
+			}
+		}
+		if (VD->Normal.hasIt) {
+			glm::vec3 n;
+			memcpy(&n, src + LD->Normal.offset, sizeof(n));
+			if (VD->Normal.format == VK_FORMAT_R16G16_SNORM) {
+				glm::vec2 e = octEncode(n);
+				int16_t o[2] = { packSnorm16(e.x), packSnorm16(e.y) };
+				memcpy(dst + VD->Normal.offset, o, sizeof(o));
+			}
+			else {
+				memcpy(dst + VD->Normal.offset, &n, sizeof(n));
+			}
+		}
+		if (VD->UV.hasIt) {
+			glm::vec2 uv;
+			memcpy(&uv, src + LD->UV.offset, sizeof(uv));
+			if (VD->UV.format == VK_FORMAT_R16G16_UNORM) {
+				if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) {
+					clampedUV++;
+				}
+				uint16_t o[2] = { packUnorm16(uv.x), packUnorm16(uv.y) };
+				memcpy(dst + VD->UV.offset, o, sizeof(o));
+			}
+			else {
+				memcpy(dst + VD->UV.offset, &uv, sizeof(uv));
+			}
+		}
+		if (VD->Color.hasIt) {
+			memcpy(dst + VD->Color.offset, src + LD->Color.offset, sizeof(glm::vec3));
+		}
+		if (VD->Tangent.hasIt) {
+			memcpy(dst + VD->Tangent.offset, src + LD->Tangent.offset, sizeof(glm::vec4));
+		}
+	}
+	vertices.swap(packed);
 
-	void* data;
-	vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(BP->device, vertexBufferMemory);
+	if (VD->Position.hasIt && VD->Position.format == VK_FORMAT_R16G16B16A16_SNORM) {
+		Qm = glm::translate(glm::mat4(1), center) * glm::scale(glm::mat4(1), extent);
+	}
+	std::cout << "[Quantized] " << srcStride << " -> " << dstStride << " bytes per vertex\n";
+	if (clampedUV > 0) {
+		std::cout << "Warning: " << clampedUV << " UVs outside [0,1] clamped by the UNORM layout\n";
+	}
 }
 
-inline void Model::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBuffer, indexBufferMemory);
+inline void Model::load(std::string file, ModelType MT) {
+	// The cache is keyed on the source contents, so edited assets are re-cooked automatically
+	uint64_t sourceHash = 0;
+	{
+		AssetFile source;
+		if (source.open(file)) {
+			sourceHash = source.hash();
+		}
+	}
+	// UVs moved into an atlas tile are part of the cooked data
+	if (uvScaleOffset != glm::vec4(1.0f, 1.0f, 0.0f, 0.0f)) {
+		sourceHash = hashBytes(&uvScaleOffset, sizeof(uvScaleOffset), sourceHash);
+	}
+	std::string cacheFile = file + ".cache";
+
+	// The cache in the pack may be older than the loose one written since the pack was cooked
+	bool cached = loadCache(cacheFile, sourceHash, MT, true) ||
+		(isPackedAsset(cacheFile) && loadCache(cacheFile, sourceHash, MT, false));
+	if (!cached) {
+		VertexDescriptor floatVD;
+		LD = VD;
+		if (VD->quantized()) {
+			floatVD = VD->floatLayout();
+			LD = &floatVD;
+		}
 
-	void* data;
-	vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(BP->device, indexBufferMemory);
+		if (MT == OBJ) {
+			loadModelOBJ(file);
+		}
+		else if (MT == GLTF) {
+			loadModelGLTF(file, false);
+		}
+		else if (MT == MGCG) {
+			loadModelGLTF(file, true);
+		}
+		generateLods();
+		if (optimizeMesh) {
+			optimize();
+		}
+		applyUvScaleOffset();
+		if (LD != VD) {
+			quantize();
+		}
+		LD = VD;
+		saveCache(cacheFile, sourceHash, MT);
+	}
 }
 
-inline void Model::initMesh(BaseProject* bp, VertexDescriptor* vd) {
+inline void Model::init(BaseProject* bp, VertexDescriptor* vd, std::string file, ModelType MT) {
 	BP = bp;
 	VD = vd;
-	int mainStride = VD->Bindings[0].stride;
-	std::cout << "[Manual] Vertices: " << (vertices.size() / mainStride)
-		<< " Indices: " << indices.size() << "\n";
+	name = file;
+	BP->liveModels.insert(this);
+	Wm = glm::mat4(1);
+	Qm = glm::mat4(1);
+
+	load(file, MT);
+
 	createVertexBuffer();
 	createIndexBuffer();
-	Wm = glm::mat4(1);
+	applyResidency();
 }
 
-inline void Model::init(BaseProject* bp, VertexDescriptor* vd, std::string file, ModelType MT) {
+// Same as init(), but the file is loaded by the asset loader and the buffers are created at its join point
+inline void Model::initAsync(BaseProject* bp, VertexDescriptor* vd, std::string file, ModelType MT) {
 	BP = bp;
 	VD = vd;
+	name = file;
+	BP->liveModels.insert(this);
 	Wm = glm::mat4(1);
+	Qm = glm::mat4(1);
+
+	BP->prefetchAsset(file);
+	BP->prefetchAsset(file + ".cache");
+	BP->assetLoader.submit([this, file, MT]() {
+		load(file, MT);
+	}, [this]() {
+		createVertexBuffer();
+		createIndexBuffer();
+		applyResidency();
+	});
+}
 
-	if (MT == OBJ) {
-		loadModelOBJ(file);
+inline void Model::cleanup() {
+	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
+	BP->memoryAllocator.free(indexBufferMemory);
+	vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
+	BP->memoryAllocator.free(vertexBufferMemory);
+	BP->liveModels.erase(this);
+	if (BP->boundModel == this) {
+		BP->boundModel = nullptr;
+	}
+}
+
+// Pixels on screen covered by one model unit at the center of the bounds, 0 behind the camera.
+// pixelsPerUnit is the height in pixels of one unit at distance one: |P[1][1]| * viewport height / 2.
+inline float Model::projectedScale(const glm::mat4& world, const glm::mat4& viewPrj, float pixelsPerUnit) {
+	float w = (viewPrj * world * glm::vec4(boundsCenter, 1.0f)).w;
+	if (w <= 0.0f) {
+		return 0.0f;
+	}
+	float scale = std::max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])) });
+	return scale * pixelsPerUnit / w;
+}
+
+// Coarsest level whose error covers at most lodPixelError pixels on screen.
+// Moving to a coarser level than current takes a 25% margin, so that objects near a threshold
+// do not switch back and forth.
+inline uint32_t Model::selectLod(const glm::mat4& world, const glm::mat4& viewPrj, float pixelsPerUnit, uint32_t current) {
+	if (lods.size() < 2) {
+		return 0;
 	}
-	else if (MT == GLTF) {
-		loadModelGLTF(file, false);
+	float pixels = projectedScale(world, viewPrj, pixelsPerUnit);
+	if (pixels <= 0.0f) {
+		return std::min<uint32_t>(current, (uint32_t)lods.size() - 1);	// behind the camera
 	}
-	else if (MT == MGCG) {
-		loadModelGLTF(file, true);
+	for (uint32_t lod = (uint32_t)lods.size() - 1; lod > 0; lod--) {
+		float threshold = lod > current ? 0.75f * lodPixelError : lodPixelError;
+		if (lods[lod].error * pixels <= threshold) {
+			return lod;
+		}
 	}
+	return 0;
+}
 
-	createVertexBuffer();
-	createIndexBuffer();
+// Diameter in pixels of the bounding sphere on screen, for Texture::requestResolution
+inline float Model::screenSize(const glm::mat4& world, const glm::mat4& viewPrj, float pixelsPerUnit) {
+	return 2.0f * boundsRadius * projectedScale(world, viewPrj, pixelsPerUnit);
 }
 
-inline void Model::cleanup() {
-	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
-	vkFreeMemory(BP->device, indexBufferMemory, nullptr);
-	vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
-	vkFreeMemory(BP->device, vertexBufferMemory, nullptr);
+inline VkDrawIndexedIndirectCommand Model::lodDraw(uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) {
+	const ModelLod& L = lods[std::min<size_t>(lod, lods.size() - 1)];
+	VkDrawIndexedIndirectCommand C{};
+	C.indexCount = L.indexCount;
+	C.instanceCount = instanceCount;
+	C.firstIndex = L.firstIndex;
+	C.vertexOffset = 0;
+	C.firstInstance = firstInstance;
+	return C;
 }
 
 inline void Model::bind(VkCommandBuffer commandBuffer) {
@@ -2875,23 +5316,97 @@ inline void Model::bind(VkCommandBuffer commandBuffer) {
 	VkDeviceSize offsets[] = { 0 };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 	// property .indexBuffer of models, contains the VkBuffer handle to its index buffer
-	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
-		VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+	bindCount++;
+	BP->boundModel = this;
 }
 
+// Draws the whole mesh (lods[0]) with the buffers of the last bind()
+inline void Model::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount) {
+	vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, 0);
+	drawCount++;
+}
+
+inline VkDeviceSize Model::deviceBytes() const {
+	return vertexBufferMemory.size + indexBufferMemory.size;
+}
 
 
 
 
 
-inline void Texture::createTextureImage(std::string files[], VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
-	int texWidth, texHeight, texChannels;
+
+// Cooked textures live next to their source: textures/T_Mike.png -> textures/T_Mike.png.ktx2.
+// The source extension is kept, so that X.png and X.jpg do not share a twin
+inline std::string cookedTextureFile(const std::string& file) {
+	return file + ".ktx2";
+}
+
+inline bool Texture::loadCookedImage(const std::string& file) {
+	std::string cookedName = cookedTextureFile(file);
+	// stale KTX2 files are left out of the pack by the cooker, loose ones are checked here
+	if (!isPackedAsset(cookedName)) {
+		std::error_code ec;
+		auto cookedTime = std::filesystem::last_write_time(cookedName, ec);
+		if (ec) {
+			return false;
+		}
+		auto sourceTime = std::filesystem::last_write_time(file, ec);
+		if (!ec && sourceTime > cookedTime) {
+			std::cout << "Stale  : " << cookedName << ", using " << file << "\n";
+			return false;
+		}
+	}
+	if (!cookedFile.open(cookedName)) {
+		return false;
+	}
+	try {
+		cooked = Ktx2::parse(cookedFile.data, cookedFile.size);
+	}
+	catch (const std::exception& e) {
+		std::cout << cookedName << ": " << e.what() << ", using " << file << "\n";
+		cookedFile.close();
+		return false;
+	}
+	if (cooked.faces != (uint32_t)imgs) {
+		cookedFile.close();
+		return false;
+	}
+	sourceFile = file;
+	texWidth = cooked.width;
+	texHeight = cooked.height;
+	std::cout << "[KTX2] " << cookedName << " -> size: " << texWidth << "x" << texHeight
+		<< ", " << Ktx2::formatName(cooked.vkFormat) << ", " << cooked.levels.size() << " levels\n";
+	return true;
+}
+
+// Only the 8-bit color formats have a block compressed twin
+inline bool Texture::hasCookedFormat(VkFormat Fmt) const {
+	return imgs == 1 && (Fmt == VK_FORMAT_R8G8B8A8_SRGB || Fmt == VK_FORMAT_R8G8B8A8_UNORM);
+}
+
+// The twin needs a BC capable device: the other textures decode their image, in the asset
+// loader job for initAsync(). Jobs queued by localLoad() wait here for the physical device
+inline bool Texture::useCookedImage(VkFormat Fmt) const {
+	return hasCookedFormat(Fmt) && BP->textureCompressionBCReady.get();
+}
+
+inline void Texture::loadTextureImages(std::string files[], bool useCooked) {
+	if (useCooked && loadCookedImage(files[0])) {
+		return;
+	}
+
 	int curWidth = -1, curHeight = -1, curChannels = -1;
-	stbi_uc* pixels[maxImgs];
+	int texChannels;
+	pixels.resize(imgs);
 
 	for (int i = 0; i < imgs; i++) {
-		pixels[i] = stbi_load(files[i].c_str(), &texWidth, &texHeight,
-			&texChannels, STBI_rgb_alpha);
+		AssetFile source;
+		pixels[i] = nullptr;
+		if (source.open(files[i])) {
+			pixels[i] = stbi_load_from_memory(source.data, (int)source.size, &texWidth, &texHeight,
+				&texChannels, texelBytes == 1 ? STBI_grey : STBI_rgb_alpha);
+		}
 		if (!pixels[i]) {
 			std::cout << "Not found: " << files[i] << "\n";
 			throw std::runtime_error("failed to load texture image!");
@@ -2912,27 +5427,28 @@ inline void Texture::createTextureImage(std::string files[], VkFormat Fmt = VK_F
 			}
 		}
 	}
+}
+
+inline void Texture::uploadTextureImage(VkFormat Fmt) {
+	// loaded by loadTextureImages() only when useCookedImage(Fmt)
+	if (cookedFile.data != nullptr) {
+		uploadCookedImage(Fmt);
+		return;
+	}
 
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	VkDeviceSize totalImageSize = texWidth * texHeight * 4 * imgs;
+	imageFormat = Fmt;
+	VkDeviceSize imageSize = texWidth * texHeight * texelBytes;
+	VkDeviceSize totalImageSize = imageSize * imgs;
 	mipLevels = static_cast<uint32_t>(std::floor(
 		std::log2(std::max(texWidth, texHeight)))) + 1;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	BP->createBuffer(totalImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemory);
 	void* data;
-	vkMapMemory(BP->device, stagingBufferMemory, 0, totalImageSize, 0, &data);
+	VkBuffer stagingBuffer = BP->stageUpload(totalImageSize, data);
 	for (int i = 0; i < imgs; i++) {
 		memcpy(static_cast<char*>(data) + imageSize * i, pixels[i], static_cast<size_t>(imageSize));
 		stbi_image_free(pixels[i]);
 	}
-	vkUnmapMemory(BP->device, stagingBufferMemory);
-
+	pixels.clear();
 
 	BP->createImage(texWidth, texHeight, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
 		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
@@ -2941,16 +5457,156 @@ inline void Texture::createTextureImage(std::string files[], VkFormat Fmt = VK_F
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
 		textureImageMemory);
 
-	BP->transitionImageLayout(textureImage, Fmt,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, imgs);
-	BP->copyBufferToImage(stagingBuffer, textureImage,
-		static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), imgs);
+	// the staging buffer is released by the upload batch
+	BP->uploadImage(stagingBuffer, textureImage, Fmt, texWidth, texHeight, mipLevels, imgs);
+}
+
+// The cooked levels are copied as they are: no decoding and no mip generation.
+// Shared 2D textures start with their mip tail only, the finer levels are streamed later
+// (see BaseProject::textureBudget). Atlases are not streamed: atlasMaxLod counts levels from
+// the full-size image, and a mip tail would let the sampler go past the gutter.
+inline void Texture::uploadCookedImage(VkFormat Fmt) {
+	imageFormat = (VkFormat)Ktx2::withColorSpace(cooked.vkFormat, Fmt == VK_FORMAT_R8G8B8A8_SRGB);
+	uint32_t firstLevel = 0;
+	if (BP->textureBudget > 0 && !registryKey.empty() && imgs == 1 && atlasMaxLod < 0) {
+		while (firstLevel + 1 < cooked.levels.size() &&
+			std::max(cooked.levels[firstLevel].width, cooked.levels[firstLevel].height) > BP->streamingTailSize) {
+			firstLevel++;
+		}
+	}
+	mipLevels = static_cast<uint32_t>(cooked.levels.size()) - firstLevel;
+
+	VkDeviceSize totalImageSize = 0;
+	for (uint32_t i = firstLevel; i < cooked.levels.size(); i++) {
+		totalImageSize += cooked.levels[i].size;
+	}
+
+	void* data;
+	VkBuffer stagingBuffer = BP->stageUpload(totalImageSize, data);
+	std::vector<VkBufferImageCopy> regions;
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		const Ktx2::Level& L = cooked.levels[firstLevel + i];
+		memcpy(static_cast<char*>(data) + offset, cookedFile.data + L.offset, static_cast<size_t>(L.size));
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = i;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = imgs;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { L.width, L.height, 1 };
+		regions.push_back(region);
+		offset += L.size;
+	}
+	cookedFile.close();
+	if (firstLevel > 0) {
+		BP->startStreaming(registryKey, cookedTextureFile(sourceFile), cooked, imageFormat, firstLevel);
+	}
+
+	const Ktx2::Level& L0 = cooked.levels[firstLevel];
+	BP->createImage(L0.width, L0.height, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, imageFormat,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		imgs == 6 ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
+		textureImageMemory);
+
+	BP->uploadImage(stagingBuffer, textureImage, imageFormat, L0.width, L0.height, mipLevels, imgs, regions);
+}
+
+// Asks for the level of the texture that covers the given number of pixels on screen
+// (along its largest side): used by mip streaming, ignored by the other textures
+inline void Texture::requestResolution(float pixels) {
+	if (!registryKey.empty()) {
+		BP->requestTextureResolution(registryKey, pixels, glm::vec2(uvScaleOffset));
+	}
+}
+
+// Replaces the equirectangular panorama in pixels[0] with the six faces of a cube map
+// (+X, -X, +Y, -Y, +Z, -Z), using the direction -> texel mapping of SkyBoxShader.frag:
+// u = 0.5 - atan(x, z) / 2pi, v = 0.5 - atan(y, length(x, z)) / pi, bilinearly filtered.
+// The face rows are split among all the hardware threads. faceSize 0 picks a quarter of
+// the panorama width, which keeps about the same texel density at the horizon.
+inline void Texture::convertEquirectToCube(int faceSize) {
+	auto t0 = std::chrono::high_resolution_clock::now();
+	const stbi_uc* src = pixels[0];
+	int srcWidth = texWidth, srcHeight = texHeight;
+	if (faceSize <= 0) {
+		faceSize = std::max(srcWidth / 4, 1);
+	}
+
+	std::vector<stbi_uc*> faces(6);
+	for (auto& face : faces) {
+		// released with stbi_image_free() after the upload, like decoded images
+		face = (stbi_uc*)malloc((size_t)faceSize * faceSize * 4);
+		if (!face) {
+			throw std::runtime_error("failed to allocate cube map face!");
+		}
+	}
+
+	auto convertRows = [&](int first, int step) {
+		for (int row = first; row < 6 * faceSize; row += step) {
+			int f = row / faceSize, y = row % faceSize;
+			float t = 2.0f * (y + 0.5f) / faceSize - 1.0f;
+			stbi_uc* out = faces[f] + (size_t)y * faceSize * 4;
+			for (int x = 0; x < faceSize; x++) {
+				float s = 2.0f * (x + 0.5f) / faceSize - 1.0f;
+				float dx, dy, dz;
+				switch (f) {
+				case 0: dx = 1.0f; dy = -t; dz = -s; break;
+				case 1: dx = -1.0f; dy = -t; dz = s; break;
+				case 2: dx = s; dy = 1.0f; dz = t; break;
+				case 3: dx = s; dy = -1.0f; dz = -t; break;
+				case 4: dx = s; dy = -t; dz = 1.0f; break;
+				default: dx = -s; dy = -t; dz = -1.0f; break;
+				}
+				float u = 0.5f - std::atan2(dx, dz) / 6.2831853f;
+				float v = 0.5f - std::atan2(dy, std::sqrt(dx * dx + dz * dz)) / 3.14159265f;
+
+				// repeat horizontally, clamp vertically
+				float fx = u * srcWidth - 0.5f, fy = v * srcHeight - 0.5f;
+				int x0 = (int)std::floor(fx), y0 = (int)std::floor(fy);
+				float ax = fx - x0, ay = fy - y0;
+				int x1 = ((x0 + 1) % srcWidth + srcWidth) % srcWidth;
+				x0 = (x0 % srcWidth + srcWidth) % srcWidth;
+				int y1 = std::min(std::max(y0 + 1, 0), srcHeight - 1);
+				y0 = std::min(std::max(y0, 0), srcHeight - 1);
+				const stbi_uc* p00 = src + ((size_t)y0 * srcWidth + x0) * 4;
+				const stbi_uc* p01 = src + ((size_t)y0 * srcWidth + x1) * 4;
+				const stbi_uc* p10 = src + ((size_t)y1 * srcWidth + x0) * 4;
+				const stbi_uc* p11 = src + ((size_t)y1 * srcWidth + x1) * 4;
+				for (int c = 0; c < 4; c++) {
+					float top = p00[c] + (p01[c] - p00[c]) * ax;
+					float bottom = p10[c] + (p11[c] - p10[c]) * ax;
+					out[4 * x + c] = (stbi_uc)(top + (bottom - top) * ay + 0.5f);
+				}
+			}
+		}
+	};
+
+	int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; i++) {
+		workers.emplace_back(convertRows, i, threads);
+	}
+	convertRows(0, threads);
+	for (auto& worker : workers) {
+		worker.join();
+	}
 
-	BP->generateMipmaps(textureImage, Fmt,
-		texWidth, texHeight, mipLevels, imgs);
+	stbi_image_free(pixels[0]);
+	pixels = faces;
+	imgs = 6;
+	texWidth = texHeight = faceSize;
+	auto t1 = std::chrono::high_resolution_clock::now();
+	std::cout << "[Cube] " << srcWidth << "x" << srcHeight << " -> 6 x " << faceSize << "x" << faceSize
+		<< " in " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+}
 
-	vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
-	vkFreeMemory(BP->device, stagingBufferMemory, nullptr);
+inline void Texture::createTextureImage(std::string files[], VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
+	loadTextureImages(files, useCookedImage(Fmt));
+	uploadTextureImage(Fmt);
 }
 
 inline void Texture::createTextureImageView(VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
@@ -2972,60 +5628,171 @@ inline void Texture::createTextureSampler(
 	float maxAnisotropy = 16,
 	float maxLod = -1
 ) {
-	VkSamplerCreateInfo samplerInfo{};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = magFilter;
-	samplerInfo.minFilter = minFilter;
-	samplerInfo.addressModeU = addressModeU;
-	samplerInfo.addressModeV = addressModeV;
-	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.anisotropyEnable = anisotropyEnable;
-	samplerInfo.maxAnisotropy = maxAnisotropy;
-	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-	samplerInfo.unnormalizedCoordinates = VK_FALSE;
-	samplerInfo.compareEnable = VK_FALSE;
-	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-	samplerInfo.mipmapMode = mipmapMode;
-	samplerInfo.mipLodBias = 0.0f;
-	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = ((maxLod == -1) ? static_cast<float>(mipLevels) : maxLod);
-
-	VkResult result = vkCreateSampler(BP->device, &samplerInfo, nullptr,
-		&textureSampler);
-	if (result != VK_SUCCESS) {
-		PrintVkError(result);
-		throw std::runtime_error("failed to create texture sampler!");
-	}
+	// Samplers come from a cache shared by all the textures. The default maxLod does not clamp
+	// at all (the image view already limits the levels), so that it does not depend on the mip count;
+	// atlas tiles clamp at the last level that does not mix them with their neighbors
+	SamplerKey key;
+	key.magFilter = magFilter;
+	key.minFilter = minFilter;
+	key.addressModeU = addressModeU;
+	key.addressModeV = addressModeV;
+	key.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	key.mipmapMode = mipmapMode;
+	key.anisotropyEnable = anisotropyEnable;
+	key.maxAnisotropy = maxAnisotropy;
+	key.maxLod = maxLod != -1 ? maxLod : (atlasMaxLod >= 0 ? atlasMaxLod : VK_LOD_CLAMP_NONE);
+
+	textureSampler = BP->acquireSampler(key);
 }
 
 
 
+inline std::string textureRegistryKey(const std::string& file, VkFormat Fmt) {
+	return file + "|" + std::to_string((int)Fmt);
+}
+
+// Replaces file with its atlas when the atlas manifest lists it
+inline bool Texture::locateInAtlas(std::string& file) {
+	const AtlasTile* T = BP->atlasTile(file);
+	if (T == nullptr) {
+		return false;
+	}
+	file = T->atlas;
+	uvScaleOffset = T->uvScaleOffset;
+	atlasMaxLod = T->maxLod;
+	return true;
+}
+
 inline void Texture::init(BaseProject* bp, std::string file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB, bool initSampler = true) {
-	std::string files[1] = { file };
 	BP = bp;
 	imgs = 1;
-	createTextureImage(files, Fmt);
-	createTextureImageView(Fmt);
+	texelBytes = Fmt == VK_FORMAT_R8_UNORM ? 1 : 4;
+	name = file;
+	BP->liveTextures.insert(this);
+	locateInAtlas(file);
+	std::string files[1] = { file };
+	registryKey = textureRegistryKey(file, Fmt);
+	if (BP->reserveTexture(registryKey)) {
+		std::cout << "Shared : " << file << "\n";
+		BP->adoptTexture(registryKey, *this);
+	}
+	else {
+		createTextureImage(files, Fmt);
+		createTextureImageView(imageFormat);
+		BP->publishTexture(registryKey, *this);
+	}
 	if (initSampler) {
 		createTextureSampler();
 	}
 }
 
+// Same as init(), but the image is decoded by the asset loader and uploaded at its join point.
+// Textures already in the registry (even if still loading) only wait for it to be published.
+inline void Texture::initAsync(BaseProject* bp, std::string file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB, bool initSampler = true) {
+	BP = bp;
+	imgs = 1;
+	texelBytes = Fmt == VK_FORMAT_R8_UNORM ? 1 : 4;
+	name = file;
+	BP->liveTextures.insert(this);
+	locateInAtlas(file);
+	registryKey = textureRegistryKey(file, Fmt);
+	if (BP->reserveTexture(registryKey)) {
+		std::cout << "Shared : " << file << "\n";
+		BP->assetLoader.submit(nullptr, [this, initSampler]() {
+			BP->adoptTexture(registryKey, *this);
+			if (initSampler) {
+				createTextureSampler();
+			}
+		});
+		return;
+	}
+	// the job reads the cooked twin when the device can sample it and it is up to date (see
+	// loadCookedImage), and decodes the image otherwise. The device may not be picked yet:
+	// an up to date twin is prefetched, and dropped by the job when it cannot be used
+	std::string cookedName = cookedTextureFile(file);
+	std::error_code cookedError, sourceError;
+	auto cookedTime = std::filesystem::last_write_time(cookedName, cookedError);
+	auto sourceTime = std::filesystem::last_write_time(file, sourceError);
+	bool prefetchCooked = hasCookedFormat(Fmt) && !cookedError && (sourceError || sourceTime <= cookedTime);
+	BP->prefetchAsset(prefetchCooked ? cookedName : file);
+	BP->assetLoader.submit([this, file, cookedName, prefetchCooked, Fmt]() {
+		std::string files[1] = { file };
+		bool useCooked = useCookedImage(Fmt);
+		if (prefetchCooked && !useCooked) {
+			std::vector<unsigned char> unused;
+			takePrefetched(cookedName, unused);
+		}
+		loadTextureImages(files, useCooked);
+	}, [this, Fmt, initSampler]() {
+		uploadTextureImage(Fmt);
+		createTextureImageView(imageFormat);
+		BP->publishTexture(registryKey, *this);
+		if (initSampler) {
+			createTextureSampler();
+		}
+	});
+}
 
 inline void Texture::initCubic(BaseProject* bp, std::string files[6]) {
 	BP = bp;
 	imgs = 6;
+	name = files[0];
+	BP->liveTextures.insert(this);
+	registryKey.clear();
 	createTextureImage(files);
 	createTextureImageView();
 	createTextureSampler();
 }
 
+// Cube map made from an equirectangular panorama, to be sampled with a samplerCube
+inline void Texture::initEquirect(BaseProject* bp, std::string file, int faceSize = 0) {
+	std::string files[1] = { file };
+	BP = bp;
+	imgs = 1;
+	name = file;
+	BP->liveTextures.insert(this);
+	registryKey.clear();
+	loadTextureImages(files, false);
+	convertEquirectToCube(faceSize);
+	uploadTextureImage(VK_FORMAT_R8G8B8A8_SRGB);
+	createTextureImageView(imageFormat);
+	createTextureSampler();
+}
+
+// Same as initEquirect(), with the decoding and the conversion done by the asset loader
+inline void Texture::initEquirectAsync(BaseProject* bp, std::string file, int faceSize = 0) {
+	BP = bp;
+	imgs = 1;
+	name = file;
+	BP->liveTextures.insert(this);
+	registryKey.clear();
+	BP->prefetchAsset(file);
+	BP->assetLoader.submit([this, file, faceSize]() {
+		std::string files[1] = { file };
+		loadTextureImages(files, false);
+		convertEquirectToCube(faceSize);
+	}, [this]() {
+		uploadTextureImage(VK_FORMAT_R8G8B8A8_SRGB);
+		createTextureImageView(imageFormat);
+		createTextureSampler();
+	});
+}
 
 inline void Texture::cleanup() {
-	vkDestroySampler(BP->device, textureSampler, nullptr);
-	vkDestroyImageView(BP->device, textureImageView, nullptr);
-	vkDestroyImage(BP->device, textureImage, nullptr);
-	vkFreeMemory(BP->device, textureImageMemory, nullptr);
+	BP->liveTextures.erase(this);
+	if (textureSampler != VK_NULL_HANDLE) {
+		BP->releaseSampler(textureSampler);
+		textureSampler = VK_NULL_HANDLE;
+	}
+	if (registryKey.empty()) {
+		vkDestroyImageView(BP->device, textureImageView, nullptr);
+		vkDestroyImage(BP->device, textureImage, nullptr);
+		BP->memoryAllocator.free(textureImageMemory);
+	}
+	else {
+		BP->releaseTexture(registryKey, this);
+		registryKey.clear();
+	}
 }
 
 
@@ -3038,22 +5805,27 @@ inline void Pipeline::init(BaseProject* bp, VertexDescriptor* vd,
 	BP = bp;
 	VD = vd;
 
-	auto vertShaderCode = readFile(VertShader);
-	auto fragShaderCode = readFile(FragShader);
+	// SPIR-V is read in place: pack payloads and mapped files are both 4-byte aligned
+	AssetFile vertShaderCode, fragShaderCode;
+	if (!vertShaderCode.open(VertShader) || !fragShaderCode.open(FragShader)) {
+		std::cout << "Failed to open: " << (vertShaderCode.data ? FragShader : VertShader) << "\n";
+		throw std::runtime_error("failed to open file!");
+	}
 	std::cout << "Vertex shader <" << VertShader << "> len: " <<
-		vertShaderCode.size() << "\n";
+		vertShaderCode.size << "\n";
 	std::cout << "Fragment shader <" << FragShader << "> len: " <<
-		fragShaderCode.size() << "\n";
+		fragShaderCode.size << "\n";
 
 	vertShaderModule =
-		createShaderModule(vertShaderCode);
+		createShaderModule(vertShaderCode.data, vertShaderCode.size);
 	fragShaderModule =
-		createShaderModule(fragShaderCode);
+		createShaderModule(fragShaderCode.data, fragShaderCode.size);
 
 	compareOp = VK_COMPARE_OP_LESS;
 	polyModel = VK_POLYGON_MODE_FILL;
 	CM = VK_CULL_MODE_BACK_BIT;
 	transp = false;
+	fragConstants.clear();
 
 	D = d;
 }
@@ -3068,6 +5840,10 @@ inline void Pipeline::setAdvancedFeatures(VkCompareOp _compareOp,
 	transp = _transp;
 }
 
+inline void Pipeline::setFragmentConstants(std::vector<float> constants) {
+	fragConstants = constants;
+}
+
 
 inline void Pipeline::create() {
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -3084,6 +5860,21 @@ inline void Pipeline::create() {
 	fragShaderStageInfo.module = fragShaderModule;
 	fragShaderStageInfo.pName = "main";
 
+	std::vector<VkSpecializationMapEntry> fragConstantEntries(fragConstants.size());
+	for (uint32_t i = 0; i < fragConstants.size(); i++) {
+		fragConstantEntries[i].constantID = i;
+		fragConstantEntries[i].offset = i * sizeof(float);
+		fragConstantEntries[i].size = sizeof(float);
+	}
+	VkSpecializationInfo fragSpecializationInfo{};
+	fragSpecializationInfo.mapEntryCount = static_cast<uint32_t>(fragConstantEntries.size());
+	fragSpecializationInfo.pMapEntries = fragConstantEntries.data();
+	fragSpecializationInfo.dataSize = fragConstants.size() * sizeof(float);
+	fragSpecializationInfo.pData = fragConstants.data();
+	if (!fragConstants.empty()) {
+		fragShaderStageInfo.pSpecializationInfo = &fragSpecializationInfo;
+	}
+
 	VkPipelineShaderStageCreateInfo shaderStages[] =
 	{ vertShaderStageInfo, fragShaderStageInfo };
 
@@ -3234,12 +6025,21 @@ inline void Pipeline::create() {
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	result = vkCreateGraphicsPipelines(BP->device, VK_NULL_HANDLE, 1,
+	auto t0 = std::chrono::high_resolution_clock::now();
+	result = vkCreateGraphicsPipelines(BP->device, BP->pipelineCache, 1,
 		&pipelineInfo, nullptr, &graphicsPipeline);
 	if (result != VK_SUCCESS) {
 		PrintVkError(result);
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+	float ms = std::chrono::duration<float, std::milli>(t1 - t0).count();
+	std::lock_guard<std::mutex> lock(BP->pipelineStatsMutex);
+	BP->pipelinesCreated++;
+	BP->pipelineCreationMs += ms;
+	if (!BP->creatingPipelines) {
+		BP->pipelineWaitMs += ms;
+	}
 
 }
 
@@ -3255,11 +6055,11 @@ inline void Pipeline::bind(VkCommandBuffer commandBuffer) {
 
 }
 
-inline VkShaderModule Pipeline::createShaderModule(const std::vector<char>& code) {
+inline VkShaderModule Pipeline::createShaderModule(const unsigned char* code, size_t size) {
 	VkShaderModuleCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	createInfo.codeSize = size;
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code);
 
 	VkShaderModule shaderModule;
 
@@ -3317,33 +6117,24 @@ inline void DescriptorSet::init(BaseProject* bp, DescriptorSetLayout* DSL,
 	std::vector<Texture*>Txs) {
 	BP = bp;
 	Layout = DSL;
+	textures = Txs;
+	BP->liveDescriptorSets.insert(this);
+	for (Texture* T : Txs) {
+		T->bindCount++;
+	}
 
 	int size = DSL->Bindings.size();
 	int imgInfoSize = DSL->imgInfoSize;
 	//std::cout << "imgInfoSize: " << imgInfoSize << "(" << size << ")\n";
 
-	uniformBuffers.resize(size);
-	uniformBuffersMemory.resize(size);
-	toFree.resize(size);
+	uniformSlots.assign(size, UniformSlot());
 
 	//std::cout << "Descriptor set init: " << E.size() << "\n";
 	for (int j = 0; j < size; j++) {
-		uniformBuffers[j].resize(BP->swapChainImages.size());
-		uniformBuffersMemory[j].resize(BP->swapChainImages.size());
 		//std::cout << j << " " << E[j].type << "\n";
 		if (DSL->Bindings[j].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
 			//std::cout << "Uniform size: " << E[j].size << "\n";
-			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-				VkDeviceSize bufferSize = DSL->Bindings[j].linkSize;
-				BP->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					uniformBuffers[j][i], uniformBuffersMemory[j][i]);
-			}
-			toFree[j] = true;
-		}
-		else {
-			toFree[j] = false;
+			uniformSlots[j] = BP->uniformRing.allocate(DSL->Bindings[j].linkSize);
 		}
 	}
 
@@ -3370,8 +6161,8 @@ inline void DescriptorSet::init(BaseProject* bp, DescriptorSetLayout* DSL,
 		std::vector<VkDescriptorImageInfo> imageInfo(imgInfoSize);
 		for (int j = 0; j < size; j++) {
 			if (DSL->Bindings[j].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
-				bufferInfo[j].buffer = uniformBuffers[j][i];
-				bufferInfo[j].offset = 0;
+				bufferInfo[j].buffer = BP->uniformRing.buffer(uniformSlots[j]);
+				bufferInfo[j].offset = BP->uniformRing.offset(uniformSlots[j], (int)i);
 				bufferInfo[j].range = DSL->Bindings[j].linkSize;
 
 				descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -3407,15 +6198,47 @@ inline void DescriptorSet::init(BaseProject* bp, DescriptorSetLayout* DSL,
 	}
 }
 
-inline void DescriptorSet::cleanup() {
-	for (int j = 0; j < uniformBuffers.size(); j++) {
-		if (toFree[j]) {
-			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-				vkDestroyBuffer(BP->device, uniformBuffers[j][i], nullptr);
-				vkFreeMemory(BP->device, uniformBuffersMemory[j][i], nullptr);
+// Rewrites the sets of every image, or of currentImage only
+inline void DescriptorSet::updateTextures(int currentImage) {
+	for (size_t i = 0; i < descriptorSets.size(); i++) {
+		if (currentImage >= 0 && (int)i != currentImage) {
+			continue;
+		}
+		std::vector<VkWriteDescriptorSet> descriptorWrites;
+		std::vector<VkDescriptorImageInfo> imageInfo(Layout->imgInfoSize);
+		for (const auto& B : Layout->Bindings) {
+			if (B.type != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+				continue;
 			}
+			for (int k = 0; k < B.count; k++) {
+				int h = B.linkSize + k;
+				imageInfo[h].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				imageInfo[h].imageView = textures[h]->textureImageView;
+				imageInfo[h].sampler = textures[h]->textureSampler;
+			}
+
+			VkWriteDescriptorSet W{};
+			W.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			W.dstSet = descriptorSets[i];
+			W.dstBinding = B.binding;
+			W.dstArrayElement = 0;
+			W.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			W.descriptorCount = B.count;
+			W.pImageInfo = &imageInfo[B.linkSize];
+			descriptorWrites.push_back(W);
 		}
+		vkUpdateDescriptorSets(BP->device,
+			static_cast<uint32_t>(descriptorWrites.size()),
+			descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+inline void DescriptorSet::cleanup() {
+	BP->liveDescriptorSets.erase(this);
+	for (UniformSlot& S : uniformSlots) {
+		BP->uniformRing.release(S);
 	}
+	uniformSlots.clear();
 }
 
 inline void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline& P, int setId,
@@ -3428,12 +6251,152 @@ inline void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline& P, int
 }
 
 inline void DescriptorSet::map(int currentImage, void* src, int slot) {
-	void* data;
-
 	int size = Layout->Bindings[slot].linkSize;
 
-	vkMapMemory(BP->device, uniformBuffersMemory[slot][currentImage], 0,
-		size, 0, &data);
-	memcpy(data, src, size);
-	vkUnmapMemory(BP->device, uniformBuffersMemory[slot][currentImage]);
+	// the ring stays mapped for its whole life
+	memcpy(BP->uniformRing.data(uniformSlots[slot], currentImage), src, size);
+}
+
+inline void IndirectDraws::init(BaseProject* bp, const std::vector<VkDrawIndexedIndirectCommand>& defaults) {
+	BP = bp;
+	size_t images = BP->swapChainImages.size();
+	VkDeviceSize bufferSize = sizeof(VkDrawIndexedIndirectCommand) * defaults.size();
+
+	buffers.resize(images);
+	buffersMemory.resize(images);
+	commands.resize(images);
+	for (size_t i = 0; i < images; i++) {
+		BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			buffers[i], buffersMemory[i]);
+		commands[i] = (VkDrawIndexedIndirectCommand*)buffersMemory[i].mapped;
+		memcpy(commands[i], defaults.data(), (size_t)bufferSize);
+	}
+}
+
+inline void IndirectDraws::cleanup() {
+	for (size_t i = 0; i < buffers.size(); i++) {
+		vkDestroyBuffer(BP->device, buffers[i], nullptr);
+		BP->memoryAllocator.free(buffersMemory[i]);
+	}
+	buffers.clear();
+	buffersMemory.clear();
+	commands.clear();
+}
+
+inline void IndirectDraws::set(int currentImage, uint32_t slot, const VkDrawIndexedIndirectCommand& C) {
+	commands[currentImage][slot] = C;
+}
+
+inline void IndirectDraws::draw(VkCommandBuffer commandBuffer, int currentImage, uint32_t slot) {
+	vkCmdDrawIndexedIndirect(commandBuffer, buffers[currentImage],
+		slot * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+	if (BP->boundModel != nullptr) {
+		BP->boundModel->drawCount++;
+	}
+}
+
+inline void UniformRing::init(BaseProject* bp) {
+	BP = bp;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(BP->physicalDevice, &properties);
+	alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+}
+
+inline UniformSlot UniformRing::allocate(VkDeviceSize size) {
+	uint32_t count = (uint32_t)BP->swapChainImages.size();
+	if (count != images) {
+		if (live > 0) {
+			throw std::runtime_error("uniform ring: the swap chain images changed under live descriptor sets!");
+		}
+		// all the descriptor sets are gone: the blocks follow the new swap chain
+		cleanup();
+		images = count;
+	}
+
+	UniformSlot S;
+	S.size = (size + alignment - 1) / alignment * alignment;
+	auto it = freeSlots.find(S.size);
+	if (it != freeSlots.end()) {
+		S = it->second;
+		freeSlots.erase(it);
+		live++;
+		return S;
+	}
+	for (uint32_t b = 0; b < blocks.size(); b++) {
+		if (blocks[b].top + S.size <= blocks[b].regionSize) {
+			S.block = b;
+			S.offset = blocks[b].top;
+			blocks[b].top += S.size;
+			live++;
+			return S;
+		}
+	}
+
+	Block B;
+	B.regionSize = std::max((regionSize + alignment - 1) / alignment * alignment, S.size);
+	BP->createBuffer(B.regionSize * images, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, memoryProperties,
+		B.buffer, B.memory);
+	B.top = S.size;
+	blocks.push_back(B);
+	S.block = (uint32_t)blocks.size() - 1;
+	S.offset = 0;
+	live++;
+	return S;
+}
+
+inline void UniformRing::release(UniformSlot& S) {
+	if (S.size == 0) {
+		return;
+	}
+	freeSlots.insert({ S.size, S });
+	S = UniformSlot();
+	if (--live == 0) {
+		// nothing left in the blocks: they start over, free of holes
+		freeSlots.clear();
+		for (Block& B : blocks) {
+			B.top = 0;
+		}
+	}
+}
+
+inline VkBuffer UniformRing::buffer(const UniformSlot& S) const {
+	return blocks[S.block].buffer;
+}
+
+inline VkDeviceSize UniformRing::offset(const UniformSlot& S, int currentImage) const {
+	return currentImage * blocks[S.block].regionSize + S.offset;
+}
+
+inline void* UniformRing::data(const UniformSlot& S, int currentImage) const {
+	return (char*)blocks[S.block].memory.mapped + offset(S, currentImage);
+}
+
+inline void UniformRing::flush(int currentImage) {
+	for (const Block& B : blocks) {
+		BP->memoryAllocator.flush(B.memory, currentImage * B.regionSize, B.top);
+	}
+}
+
+inline void UniformRing::printStats(std::ostream& out) const {
+	VkDeviceSize used = 0, total = 0;
+	for (const Block& B : blocks) {
+		used += B.top;
+		total += B.regionSize;
+	}
+	out << "  uniform ring: " << live << " uniform buffers in " << blocks.size() << " blocks, "
+		<< used / 1024 << " of " << total / 1024 << " KB per image, " << images << " images"
+		<< (blocks.empty() || BP->memoryAllocator.isCoherent(blocks[0].memory) ? "" : ", flushed every frame") << "\n";
+}
+
+inline void UniformRing::cleanup() {
+	for (Block& B : blocks) {
+		vkDestroyBuffer(BP->device, B.buffer, nullptr);
+		BP->memoryAllocator.free(B.memory);
+	}
+	blocks.clear();
+	freeSlots.clear();
+	images = 0;
+	live = 0;
 }
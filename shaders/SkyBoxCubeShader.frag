@@ -0,0 +1,12 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 1) uniform samplerCube skybox;
+
+void main() {
+	outColor = texture(skybox, fragTexCoord)*0.9;
+}
\ No newline at end of file
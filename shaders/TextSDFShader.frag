@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2D texSampler;
+
+// The field holds 0.5 + d / (2 * spread), d the distance in font units from the outline of the
+// glyph; TextMaker sets the constants from FontsSDF.hpp, the defaults match FontCook's.
+layout(constant_id = 0) const float spread = 10.0f;
+layout(constant_id = 1) const float fontUnitU = 1.0f / 1024.0f;
+layout(constant_id = 2) const float fontUnitV = 1.0f / 1024.0f;
+
+const vec4 FGcolor = vec4(1.0f);
+const vec4 BGcolor = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+const vec4 SHcolor = vec4(0.0f, 0.0f, 0.0f, 0.5f);
+
+void main() {
+	// the border of the bitmap fonts is 3 font units wide, and their shadow is 3 font units
+	// down and right
+	float borderEdge = 0.5f - 1.5f / spread;
+	vec2 shadowOffset = vec2(fontUnitU, fontUnitV) * 3.0f;
+
+	float d = texture(texSampler, fragTexCoord).r;
+	// antialiasing over about one pixel, whatever the size of the text
+	float w = max(0.7f * fwidth(d), 0.001f);
+	float fill = smoothstep(0.5f - w, 0.5f + w, d);
+	float border = smoothstep(borderEdge - w, borderEdge + w, d);
+	float shadow = smoothstep(borderEdge - w, borderEdge + w, texture(texSampler, fragTexCoord - shadowOffset).r);
+	outColor = fill * FGcolor + (border - fill) * BGcolor + shadow * (1.0f - border) * SHcolor;
+}
@@ -5,7 +5,7 @@
 // Their type and location must match the definition given in the
 // corresponding Vertex Descriptor, and in turn, with the CPP data structure
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNorm;
+layout(location = 1) in vec2 inNorm; // octahedral encoding, see octDecode()
 layout(location = 2) in vec2 inUV;
 
 // this defines the variable passed to the Fragment Shader
@@ -23,6 +23,15 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 	mat4 nMat;
 } ubo;
 
+// Normals are stored as the point where they cross the octahedron |x|+|y|+|z| = 1,
+// with the lower half folded over the upper one (octEncode in starter.hpp)
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += mix(vec2(t), vec2(-t), step(vec2(0.0), n.xy));
+	return normalize(n);
+}
+
 // Here the shader simply computes clipping coordinates, and passes to the Fragment Shader
 // the position of the point in World Space, the transformed direction of the normal vector,
 // and the untouched (but interpolated) UV coordinates
@@ -31,6 +40,6 @@ void main() {
 	gl_Position = ubo.mvpMat * vec4(inPosition, 1.0);
 	// Here the value of the out variables passed to the Fragment shader are computed
 	fragPos = (ubo.mMat * vec4(inPosition, 1.0)).xyz;
-	fragNorm = (ubo.nMat * vec4(inNorm, 0.0)).xyz;
+	fragNorm = (ubo.nMat * vec4(octDecode(inNorm), 0.0)).xyz;
 	fragUV = inUV;
 }
\ No newline at end of file
@@ -71,6 +71,64 @@ void Application::calculateDescriptorPoolSizes()
 	DPSZs.setsInPool = totalSets * 10;
 }
 
+// Asset loading, queued before the Vulkan device is created
+void Application::localLoad()
+{
+	// Initialize Vertex Descriptors
+	VDGeneric.init(this, { {0, sizeof(GenericVertex), VK_VERTEX_INPUT_RATE_VERTEX} }, { {0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(GenericVertex, pos), sizeof(GenericVertex::pos), POSITION}, {0, 1, VK_FORMAT_R16G16_SNORM, offsetof(GenericVertex, norm), sizeof(GenericVertex::norm), NORMAL}, {0, 2, VK_FORMAT_R16G16_UNORM, offsetof(GenericVertex, UV), sizeof(GenericVertex::UV), UV} });
+	VDSkyBox.init(this, { {0, sizeof(SkyBoxVertex), VK_VERTEX_INPUT_RATE_VERTEX} }, { {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SkyBoxVertex, pos), sizeof(glm::vec3), POSITION} });
+
+	// Create Models and Textures (loaded in parallel, one load group per scene)
+	// The car, the mikes, the upgrades and the trophy get simplified levels of detail
+	MCar.lodLevels = 3;
+	MMike.lodLevels = 3;
+	MUpgrade.lodLevels = 3;
+	MTrophy.lodLevels = 3;
+
+	// Textures come first: the ones packed in an atlas (see AtlasCook) give the UV scale and
+	// offset of their tile to the models drawn with them
+
+	// Title: uploaded when localInit returns
+	assetLoader.setGroup(LOAD_TITLE);
+	TCar.initAsync(this, "textures/T_Car.png");
+	TSkyBox.initEquirectAsync(this, "textures/T_SkyBox.png");
+	TTitle1.initAsync(this, "textures/T_Titles.png");
+	MCar.uvScaleOffset = TCar.uvScaleOffset;
+	MTitle1.uvScaleOffset = TTitle1.uvScaleOffset;
+	MCar.initAsync(this, &VDGeneric, "models/CarHighPoly.obj", OBJ);
+	MSkyBox.initAsync(this, &VDSkyBox, "models/SkyBox.obj", OBJ);
+	MTitle1.initAsync(this, &VDGeneric, "models/Title1.obj", OBJ);
+
+	// Gameplay: streamed while the title is shown
+	assetLoader.setGroup(LOAD_GAMEPLAY);
+	TGeneric.initAsync(this, "textures/Textures.png");
+	TMike.initAsync(this, "textures/T_Mike.png");
+	TFloor.initAsync(this, "textures/T_Floor.jpg");
+	TBullet.initAsync(this, "textures/Textures.png");
+	TUpgrade.initAsync(this, "textures/Textures.png");
+	TGrass.initAsync(this, "textures/grass.jpg");
+	TFence.initAsync(this, "textures/T_Fence.jpg");
+	MMike.uvScaleOffset = TGeneric.uvScaleOffset;
+	MBullet.uvScaleOffset = TBullet.uvScaleOffset;
+	MUpgrade.uvScaleOffset = TUpgrade.uvScaleOffset;
+	MMike.initAsync(this, &VDGeneric, "models/Mike.mgcg", MGCG);
+	MFloor.initAsync(this, &VDGeneric, "models/squarefloor128.obj", OBJ);
+	MGrass.initAsync(this, &VDGeneric, "models/outergrass16.obj", OBJ);
+	MFence.initAsync(this, &VDGeneric, "models/Fence.obj", OBJ);
+	MBullet.initAsync(this, &VDGeneric, "models/Bullet.obj", OBJ);
+	MUpgrade.initAsync(this, &VDGeneric, "models/Upgrade.obj", OBJ);
+
+	// Game over: streamed after the gameplay assets
+	assetLoader.setGroup(LOAD_GAME_OVER);
+	TTitle2.initAsync(this, "textures/T_Titles.png");
+	MTitle2.uvScaleOffset = TTitle2.uvScaleOffset;
+	MTitle2.initAsync(this, &VDGeneric, "models/Title2.obj", OBJ);
+	MTrophy.initAsync(this, &VDGeneric, "models/Trophy.obj", OBJ);
+	TTrophy1.initAsync(this, "textures/T_Trophy1.png");
+	TTrophy2.initAsync(this, "textures/T_Trophy2.png");
+	TTrophy3.initAsync(this, "textures/T_Trophy3.png");
+}
+
 // Initialization of local resources
 void Application::localInit()
 {
@@ -97,47 +155,14 @@ void Application::localInit()
 	DSLTitles.init(this, { {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS, sizeof(ToonUniformBufferObject), 1},
 						  {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0, 1} });
 
-	// Initialize Vertex Descriptors
-	VDGeneric.init(this, { {0, sizeof(GenericVertex), VK_VERTEX_INPUT_RATE_VERTEX} }, { {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(GenericVertex, pos), sizeof(glm::vec3), POSITION}, {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(GenericVertex, norm), sizeof(glm::vec3), NORMAL}, {0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(GenericVertex, UV), sizeof(glm::vec2), UV} });
-	VDSkyBox.init(this, { {0, sizeof(SkyBoxVertex), VK_VERTEX_INPUT_RATE_VERTEX} }, { {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SkyBoxVertex, pos), sizeof(glm::vec3), POSITION} });
-
 	// Pipelines [Shader couples]
 	PToon.init(this, &VDGeneric, "shaders/Vert.spv", "shaders/ToonFrag.spv", { &DSLGlobal, &DSLToon });
 	PMike.init(this, &VDGeneric, "shaders/MikeVert.spv", "shaders/MikeFrag.spv", { &DSLGlobal, &DSLMike });
 	PTitles.init(this, &VDGeneric, "shaders/TitleVert.spv", "shaders/TitleFrag.spv", { &DSLTitles });
 	PTrophy.init(this, &VDGeneric, "shaders/TrophyVert.spv", "shaders/TrophyFrag.spv", { &DSLTrophy });
-	PSkyBox.init(this, &VDSkyBox, "shaders/SkyBoxVert.spv", "shaders/SkyBoxFrag.spv", { &DSLSkyBox });
+	PSkyBox.init(this, &VDSkyBox, "shaders/SkyBoxVert.spv", "shaders/SkyBoxCubeFrag.spv", { &DSLSkyBox });
 	PSkyBox.setAdvancedFeatures(VK_COMPARE_OP_LESS_OR_EQUAL, VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, false);
 
-	// Create Models
-	MCar.init(this, &VDGeneric, "models/CarHighPoly.obj", OBJ);
-	MMike.init(this, &VDGeneric, "models/Mike.mgcg", MGCG);
-	MSkyBox.init(this, &VDSkyBox, "models/SkyBox.obj", OBJ);
-	MFloor.init(this, &VDGeneric, "models/squarefloor128.obj", OBJ);
-	MGrass.init(this, &VDGeneric, "models/outergrass16.obj", OBJ);
-	MFence.init(this, &VDGeneric, "models/Fence.obj", OBJ);
-	MBullet.init(this, &VDGeneric, "models/Bullet.obj", OBJ);
-	MUpgrade.init(this, &VDGeneric, "models/Upgrade.obj", OBJ);
-	MTitle1.init(this, &VDGeneric, "models/Title1.obj", OBJ);
-	MTitle2.init(this, &VDGeneric, "models/Title2.obj", OBJ);
-	MTrophy.init(this, &VDGeneric, "models/Trophy.obj", OBJ);
-
-	// Initialize Textures
-	TGeneric.init(this, "textures/Textures.png");
-	TMike.init(this, "textures/T_Mike.png");
-	TSkyBox.init(this, "textures/T_SkyBox.png");
-	TFloor.init(this, "textures/T_Floor.jpg");
-	TCar.init(this, "textures/T_Car.png");
-	TBullet.init(this, "textures/Textures.png");
-	TUpgrade.init(this, "textures/Textures.png");
-	TTitle1.init(this, "textures/T_Titles.png");
-	TTitle2.init(this, "textures/T_Titles.png");
-	TGrass.init(this, "textures/grass.jpg");
-	TFence.init(this, "textures/T_Fence.jpg");
-	TTrophy1.init(this, "textures/T_Trophy1.png");
-	TTrophy2.init(this, "textures/T_Trophy2.png");
-	TTrophy3.init(this, "textures/T_Trophy3.png");
-
 	calculateDescriptorPoolSizes();
 
 	// Initialize text
@@ -158,37 +183,64 @@ void Application::localInit()
 // Initialize pipelines and descriptor sets
 void Application::pipelinesAndDescriptorSetsInit()
 {
-	// Create pipelines
-	PMike.create();
-	PToon.create();
-	PSkyBox.create();
-	PTitles.create();
-	PTrophy.create();
-
-	// Initialize descriptor sets
+	// Create pipelines, concurrently
+	createPipelines({ &PMike, &PToon, &PSkyBox, &PTitles, &PTrophy, &txt.P });
+
+	// Initialize descriptor sets, for the scenes whose assets are resident. The others get
+	// theirs when the pipelines are rebuilt on the scene switch
+	for (int group = 0; group < LOAD_GROUPS; ++group)
+	{
+		groupSets[group] = assetLoader.finished(group);
+	}
 	DSCar.init(this, &DSLToon, { &TCar });
-	DSMikes.init(this, &DSLMike, { &TGeneric });
-	DSBullets.resize(MAX_BULLET_INSTANCES);
-	for (int i = 0; i < MAX_BULLET_INSTANCES; ++i)
+	DSSkyBox.init(this, &DSLSkyBox, { &TSkyBox });
+	DSTitle1.init(this, &DSLTitles, { &TTitle1 });
+	if (groupSets[LOAD_GAMEPLAY])
 	{
-		DSBullets[i].init(this, &DSLToon, { &TBullet });
+		DSMikes.init(this, &DSLMike, { &TGeneric });
+		DSBullets.resize(MAX_BULLET_INSTANCES);
+		for (int i = 0; i < MAX_BULLET_INSTANCES; ++i)
+		{
+			DSBullets[i].init(this, &DSLToon, { &TBullet });
+		}
+		DSUpgrades.resize(MAX_UPGRADE_INSTANCES);
+		for (int i = 0; i < MAX_UPGRADE_INSTANCES; ++i)
+		{
+			DSUpgrades[i].init(this, &DSLToon, { &TUpgrade });
+		}
+		DSFloor.init(this, &DSLToon, { &TFloor });
+		DSGrass.init(this, &DSLToon, { &TGrass });
+		DSFence.init(this, &DSLToon, { &TFence });
 	}
-	DSUpgrades.resize(MAX_UPGRADE_INSTANCES);
-	for (int i = 0; i < MAX_UPGRADE_INSTANCES; ++i)
+	if (groupSets[LOAD_GAME_OVER])
 	{
-		DSUpgrades[i].init(this, &DSLToon, { &TUpgrade });
+		DSTitle2.init(this, &DSLTitles, { &TTitle2 });
+		DSTrophy.init(this, &DSLTrophy, { &TTrophy1, &TTrophy2, &TTrophy3 });
 	}
-	DSFloor.init(this, &DSLToon, { &TFloor });
-	DSGrass.init(this, &DSLToon, { &TGrass });
-	DSFence.init(this, &DSLToon, { &TFence });
-	DSSkyBox.init(this, &DSLSkyBox, { &TSkyBox });
-	DSTitle1.init(this, &DSLTitles, { &TTitle1 });
-	DSTitle2.init(this, &DSLTitles, { &TTitle2 });
-	DSTrophy.init(this, &DSLTrophy, { &TTrophy1, &TTrophy2, &TTrophy3 });
 	DSGlobal.init(this, &DSLGlobal, {});
 
+	// Full detail until the first update selects the levels
+	std::vector<VkDrawIndexedIndirectCommand> draws(DRAW_SLOTS);
+	draws[DRAW_CAR] = MCar.lodDraw(0);
+	if (groupSets[LOAD_GAME_OVER])
+	{
+		draws[DRAW_TROPHY] = MTrophy.lodDraw(0);
+	}
+	if (groupSets[LOAD_GAMEPLAY])
+	{
+		for (int i = 0; i < MAX_UPGRADE_INSTANCES; ++i)
+		{
+			draws[DRAW_UPGRADES + i] = MUpgrade.lodDraw(0);
+		}
+		for (int lod = 0; lod < MODEL_MAX_LODS; ++lod)
+		{
+			draws[DRAW_MIKES + lod] = MMike.lodDraw(lod, lod == 0 ? MAX_MIKE_INSTANCES : 0);
+		}
+	}
+	LodDraws.init(this, draws);
+
 	// Initialize text pipelines and descriptor sets
-	txt.pipelinesAndDescriptorSetsInit();
+	txt.pipelinesAndDescriptorSetsInit(false);
 }
 
 // Cleanup pipelines and descriptor sets
@@ -201,23 +253,30 @@ void Application::pipelinesAndDescriptorSetsCleanup()
 	PTrophy.cleanup();
 
 	DSCar.cleanup();
-	DSMikes.cleanup();
-	for (auto& ds : DSBullets)
+	DSSkyBox.cleanup();
+	DSTitle1.cleanup();
+	if (groupSets[LOAD_GAMEPLAY])
 	{
-		ds.cleanup();
+		DSMikes.cleanup();
+		for (auto& ds : DSBullets)
+		{
+			ds.cleanup();
+		}
+		for (auto& ds : DSUpgrades)
+		{
+			ds.cleanup();
+		}
+		DSFloor.cleanup();
+		DSGrass.cleanup();
+		DSFence.cleanup();
 	}
-	for (auto& ds : DSUpgrades)
+	if (groupSets[LOAD_GAME_OVER])
 	{
-		ds.cleanup();
+		DSTitle2.cleanup();
+		DSTrophy.cleanup();
 	}
-	DSFloor.cleanup();
-	DSGrass.cleanup();
-	DSFence.cleanup();
-	DSSkyBox.cleanup();
-	DSTitle1.cleanup();
-	DSTitle2.cleanup();
-	DSTrophy.cleanup();
 	DSGlobal.cleanup();
+	LodDraws.cleanup();
 
 	txt.pipelinesAndDescriptorSetsCleanup();
 }
@@ -271,83 +330,95 @@ void Application::localCleanup()
 // Populate command buffer for rendering
 void Application::populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage)
 {
-	// Render Floor
-	PToon.bind(commandBuffer);
-	MFloor.bind(commandBuffer);
-	DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
-	DSFloor.bind(commandBuffer, PToon, 1, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MFloor.indices.size()), 1, 0, 0, 0);
-
-	// Render Grass
-	PToon.bind(commandBuffer);
-	MGrass.bind(commandBuffer);
-	DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
-	DSGrass.bind(commandBuffer, PToon, 1, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MGrass.indices.size()), 1, 0, 0, 0);
-
-	// Render Fence
-	PToon.bind(commandBuffer);
-	MFence.bind(commandBuffer);
-	DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
-	DSFence.bind(commandBuffer, PToon, 1, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MFence.indices.size()), 1, 0, 0, 0);
+	if (groupSets[LOAD_GAMEPLAY])
+	{
+		// Render Floor
+		PToon.bind(commandBuffer);
+		MFloor.bind(commandBuffer);
+		DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
+		DSFloor.bind(commandBuffer, PToon, 1, currentImage);
+		MFloor.draw(commandBuffer);
+
+		// Render Grass
+		PToon.bind(commandBuffer);
+		MGrass.bind(commandBuffer);
+		DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
+		DSGrass.bind(commandBuffer, PToon, 1, currentImage);
+		MGrass.draw(commandBuffer);
+
+		// Render Fence
+		PToon.bind(commandBuffer);
+		MFence.bind(commandBuffer);
+		DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
+		DSFence.bind(commandBuffer, PToon, 1, currentImage);
+		MFence.draw(commandBuffer);
+	}
 
 	// Render Car
 	PToon.bind(commandBuffer);
 	MCar.bind(commandBuffer);
 	DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
 	DSCar.bind(commandBuffer, PToon, 1, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MCar.indices.size()), 1, 0, 0, 0);
+	LodDraws.draw(commandBuffer, currentImage, DRAW_CAR);
 
-	// Render Mike instances
-	PMike.bind(commandBuffer);
-	MMike.bind(commandBuffer);
-	DSGlobal.bind(commandBuffer, PMike, 0, currentImage);
-	DSMikes.bind(commandBuffer, PMike, 1, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MMike.indices.size()), MAX_MIKE_INSTANCES, 0, 0, 0);
-
-	// Render Bullet instances
-	PToon.bind(commandBuffer);
-	MBullet.bind(commandBuffer);
-	DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
-	for (int i = 0; i < MAX_BULLET_INSTANCES; ++i)
+	if (groupSets[LOAD_GAMEPLAY])
 	{
-		DSBullets[i].bind(commandBuffer, PToon, 1, currentImage);
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MBullet.indices.size()), 1, 0, 0, 0);
-	}
+		// Render Mike instances
+		PMike.bind(commandBuffer);
+		MMike.bind(commandBuffer);
+		DSGlobal.bind(commandBuffer, PMike, 0, currentImage);
+		DSMikes.bind(commandBuffer, PMike, 1, currentImage);
+		for (int lod = 0; lod < MODEL_MAX_LODS; ++lod)
+		{
+			LodDraws.draw(commandBuffer, currentImage, DRAW_MIKES + lod);
+		}
 
-	// Render Upgrades instances
-	PToon.bind(commandBuffer);
-	MUpgrade.bind(commandBuffer);
-	DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
-	for (int i = 0; i < MAX_UPGRADE_INSTANCES; ++i)
-	{
-		DSUpgrades[i].bind(commandBuffer, PToon, 1, currentImage);
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MUpgrade.indices.size()), 1, 0, 0, 0);
+		// Render Bullet instances
+		PToon.bind(commandBuffer);
+		MBullet.bind(commandBuffer);
+		DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
+		for (int i = 0; i < MAX_BULLET_INSTANCES; ++i)
+		{
+			DSBullets[i].bind(commandBuffer, PToon, 1, currentImage);
+			MBullet.draw(commandBuffer);
+		}
+
+		// Render Upgrades instances
+		PToon.bind(commandBuffer);
+		MUpgrade.bind(commandBuffer);
+		DSGlobal.bind(commandBuffer, PToon, 0, currentImage);
+		for (int i = 0; i < MAX_UPGRADE_INSTANCES; ++i)
+		{
+			DSUpgrades[i].bind(commandBuffer, PToon, 1, currentImage);
+			LodDraws.draw(commandBuffer, currentImage, DRAW_UPGRADES + i);
+		}
 	}
 
 	// Render Titles
 	PTitles.bind(commandBuffer);
 	MTitle1.bind(commandBuffer);
 	DSTitle1.bind(commandBuffer, PTitles, 0, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MTitle1.indices.size()), 1, 0, 0, 0);
-
-	PTitles.bind(commandBuffer);
-	MTitle2.bind(commandBuffer);
-	DSTitle2.bind(commandBuffer, PTitles, 0, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MTitle2.indices.size()), 1, 0, 0, 0);
+	MTitle1.draw(commandBuffer);
 
-	// Render Trophy
-	PTrophy.bind(commandBuffer);
-	MTrophy.bind(commandBuffer);
-	DSTrophy.bind(commandBuffer, PTrophy, 0, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MTrophy.indices.size()), 1, 0, 0, 0);
+	if (groupSets[LOAD_GAME_OVER])
+	{
+		PTitles.bind(commandBuffer);
+		MTitle2.bind(commandBuffer);
+		DSTitle2.bind(commandBuffer, PTitles, 0, currentImage);
+		MTitle2.draw(commandBuffer);
+
+		// Render Trophy
+		PTrophy.bind(commandBuffer);
+		MTrophy.bind(commandBuffer);
+		DSTrophy.bind(commandBuffer, PTrophy, 0, currentImage);
+		LodDraws.draw(commandBuffer, currentImage, DRAW_TROPHY);
+	}
 
 	// Render SkyBox
 	PSkyBox.bind(commandBuffer);
 	MSkyBox.bind(commandBuffer);
 	DSSkyBox.bind(commandBuffer, PSkyBox, 0, currentImage);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(MSkyBox.indices.size()), 1, 0, 0, 0);
+	MSkyBox.draw(commandBuffer);
 
 	// Render text
 	txt.populateCommandBuffer(commandBuffer, currentImage, currScene);
@@ -362,6 +433,8 @@ void Application::updateUniformBuffer(uint32_t currentImage)
 		setScene0(currentImage);
 		if (glfwGetKey(window, GLFW_KEY_SPACE))
 		{
+			// Blocks only if the gameplay assets have not finished streaming in
+			requireLoadGroup(LOAD_GAMEPLAY);
 			currScene = 1;
 			RebuildPipeline();
 		}
@@ -398,6 +471,16 @@ void Application::initConstantUbos()
 	TitleViewPrj = M * TitleViewMatrix;
 }
 
+float Application::pixelsPerUnit(float fovy)
+{
+	return swapChainExtent.height * 0.5f / std::tan(fovy * 0.5f);
+}
+
+float Application::screenResolution()
+{
+	return (float)std::max(swapChainExtent.width, swapChainExtent.height);
+}
+
 void Application::setScene0(uint32_t currentImage)
 {
 	timeManager.update();
@@ -406,8 +489,10 @@ void Application::setScene0(uint32_t currentImage)
 	tubo.mMat = glm::translate(glm::mat4(5.0f), glm::vec3(0.0f, 5.0f, 0.0f));
 	tubo.mvpMat = TitleViewPrj * tubo.mMat;
 	tubo.nMat = glm::inverse(glm::transpose(tubo.mMat));
+	applyQuantization(tubo.mMat, tubo.mvpMat, MTitle1);
 
 	DSTitle1.map(currentImage, &tubo, 0);
+	TTitle1.requestResolution(screenResolution());
 
 	// Update Skybox uniforms
 	SkyBoxUniformBufferObject uboSky{};
@@ -424,6 +509,10 @@ void Application::setScene0(uint32_t currentImage)
 
 	uboCar.mvpMat = TitleViewPrj * uboCar.mMat;
 	uboCar.nMat = glm::inverse(uboCar.mMat);
+	carLod = MCar.selectLod(uboCar.mMat, TitleViewPrj, pixelsPerUnit(glm::radians(45.0f)), carLod);
+	TCar.requestResolution(MCar.screenSize(uboCar.mMat, TitleViewPrj, pixelsPerUnit(glm::radians(45.0f))));
+	LodDraws.set(currentImage, DRAW_CAR, MCar.lodDraw(carLod));
+	applyQuantization(uboCar.mMat, uboCar.mvpMat, MCar);
 
 	DSCar.map(currentImage, &uboCar, 0);
 	DSCar.map(currentImage, &uboToonParC, 2);
@@ -456,8 +545,10 @@ void Application::setScene2(uint32_t currentImage)
 	// tubo.mMat = glm::rotate(tubo.mMat, glm::radians(45.0f) * passedT, glm::vec3(0.0f, 0.0f, 1.0f));
 	tubo.mvpMat = TitleViewPrj * tubo.mMat;
 	tubo.nMat = glm::inverse(glm::transpose(tubo.mMat));
+	applyQuantization(tubo.mMat, tubo.mvpMat, MTitle2);
 
 	DSTitle2.map(currentImage, &tubo, 0);
+	TTitle2.requestResolution(screenResolution());
 
 	// Update Skybox uniforms
 	SkyBoxUniformBufferObject uboSky{};
@@ -471,7 +562,11 @@ void Application::setScene2(uint32_t currentImage)
 	uboTrophy.mMat = glm::rotate(uboTrophy.mMat, glm::radians(30.0f) * passedT, glm::vec3(0.0f, 0.0f, 1.0f));
 	uboTrophy.mMat = glm::rotate(uboTrophy.mMat, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 	uboTrophy.mvpMat = TitleViewPrj * uboTrophy.mMat;
-	uboTrophy.nMat = glm::inverse(glm::transpose(tubo.mMat));
+	uboTrophy.nMat = tubo.nMat;
+	trophyLod = MTrophy.selectLod(uboTrophy.mMat, TitleViewPrj, pixelsPerUnit(glm::radians(45.0f)), trophyLod);
+	float trophyPixels = MTrophy.screenSize(uboTrophy.mMat, TitleViewPrj, pixelsPerUnit(glm::radians(45.0f)));
+	LodDraws.set(currentImage, DRAW_TROPHY, MTrophy.lodDraw(trophyLod));
+	applyQuantization(uboTrophy.mMat, uboTrophy.mvpMat, MTrophy);
 	uboTrophy.prize = 0;
 	score = car.getScore();
 
@@ -483,7 +578,11 @@ void Application::setScene2(uint32_t currentImage)
 		uboTrophy.prize = 1;
 
 	if (score > 0)
+	{
 		DSTrophy.map(currentImage, &uboTrophy, 0);
+		Texture* trophyTextures[] = { &TTrophy1, &TTrophy2, &TTrophy3 };
+		trophyTextures[uboTrophy.prize - 1]->requestResolution(trophyPixels);
+	}
 }
 
 void Application::setScene1(uint32_t currentImage)
@@ -507,6 +606,7 @@ void Application::setScene1(uint32_t currentImage)
 	car.check_collisions(mikes, upgrades);
 	if (car.getHealth() <= 0)
 	{
+		requireLoadGroup(LOAD_GAME_OVER);
 		RebuildPipeline();
 		currScene = 2;
 		return;
@@ -587,20 +687,53 @@ void Application::setScene1(uint32_t currentImage)
 	uboCar.mMat = car.getPosition4(); // local transform ("model" matrix) - matrix is ready in car object
 	uboCar.mvpMat = ViewPrjMat * uboCar.mMat; // model-view-projection matrix
 	uboCar.nMat = glm::inverse(uboCar.mMat); // normal matrix
+	carLod = MCar.selectLod(uboCar.mMat, ViewPrjMat, pixelsPerUnit(fov), carLod);
+	TCar.requestResolution(MCar.screenSize(uboCar.mMat, ViewPrjMat, pixelsPerUnit(fov)));
+	LodDraws.set(currentImage, DRAW_CAR, MCar.lodDraw(carLod));
+	applyQuantization(uboCar.mMat, uboCar.mvpMat, MCar);
 	DSCar.map(currentImage, &uboCar, 0);
 	DSCar.map(currentImage, &uboToonParC, 2);
 
 	// Update Mike uniforms
+	// Instances are stored sorted by level of detail, so that each level is drawn as one
+	// range of instances. Without drawIndirectFirstInstance the ranges cannot start past 0,
+	// and all the mikes use the finest level any of them needs.
 	MikeUniformBufferObject uboMike{};
+	std::array<glm::mat4, MAX_MIKE_INSTANCES> mikeWorld;
+	uint32_t mikeLodCount[MODEL_MAX_LODS] = {};
+	uint32_t finestMikeLod = MODEL_MAX_LODS - 1;
 	for (int i = 0; i < mikes.size(); i++)
 	{
 		glm::mat4 rotationMat = glm::rotate(glm::mat4(1.0f), mikes[i].getRotation(), glm::vec3(0.0f, 1.0f, 0.0f));
-		uboMike.mMat[i] = glm::translate(glm::mat4(1.0f), mikes[i].getPosition()) * rotationMat; // 2nd case: matrix is created here
-		uboMike.mMat[i] = glm::scale(uboMike.mMat[i], glm::vec3(0.5f));
-		uboMike.mvpMat[i] = ViewPrjMat * uboMike.mMat[i];
-		uboMike.nMat[i] = glm::inverse(glm::transpose(uboMike.mMat[i]));
+		mikeWorld[i] = glm::translate(glm::mat4(1.0f), mikes[i].getPosition()) * rotationMat; // 2nd case: matrix is created here
+		mikeWorld[i] = glm::scale(mikeWorld[i], glm::vec3(0.5f));
+		mikeLods[i] = MMike.selectLod(mikeWorld[i], ViewPrjMat, pixelsPerUnit(fov), mikeLods[i]);
+		TGeneric.requestResolution(MMike.screenSize(mikeWorld[i], ViewPrjMat, pixelsPerUnit(fov)));
+		finestMikeLod = std::min(finestMikeLod, mikeLods[i]);
+	}
+	for (int i = 0; i < mikes.size(); i++)
+	{
+		if (!drawIndirectFirstInstance)
+		{
+			mikeLods[i] = finestMikeLod;
+		}
+		mikeLodCount[mikeLods[i]]++;
+	}
+	uint32_t mikeLodStart[MODEL_MAX_LODS];
+	for (uint32_t lod = 0, first = 0; lod < MODEL_MAX_LODS; first += mikeLodCount[lod], ++lod)
+	{
+		mikeLodStart[lod] = first;
+		LodDraws.set(currentImage, DRAW_MIKES + lod, MMike.lodDraw(lod, mikeLodCount[lod], mikeLodCount[lod] ? first : 0));
+	}
+	for (int i = 0; i < mikes.size(); i++)
+	{
+		uint32_t s = mikeLodStart[mikeLods[i]]++;
+		uboMike.mMat[s] = mikeWorld[i];
+		uboMike.mvpMat[s] = ViewPrjMat * uboMike.mMat[s];
+		uboMike.nMat[s] = glm::inverse(glm::transpose(uboMike.mMat[s]));
+		applyQuantization(uboMike.mMat[s], uboMike.mvpMat[s], MMike);
 		// uboMike.showDamage[i] = 0;
-		uboMike.showDamage[i].s = mikes[i].getDamaged() ? 1 : 0;
+		uboMike.showDamage[s].s = mikes[i].getDamaged() ? 1 : 0;
 	}
 	DSMikes.map(currentImage, &uboMike, 0);
 
@@ -614,6 +747,8 @@ void Application::setScene1(uint32_t currentImage)
 		uboBullet.mMat = glm::translate(glm::mat4(1.0f), car.getBullets()[i].getPosition()) * rotationMat;
 		uboBullet.mvpMat = ViewPrjMat * uboBullet.mMat;
 		uboBullet.nMat = glm::inverse(glm::transpose(uboBullet.mMat));
+		TBullet.requestResolution(MBullet.screenSize(uboBullet.mMat, ViewPrjMat, pixelsPerUnit(fov)));
+		applyQuantization(uboBullet.mMat, uboBullet.mvpMat, MBullet);
 		DSBullets[i].map(currentImage, &uboBullet, 0);
 		DSBullets[i].map(currentImage, &uboToonPar, 2);
 	}
@@ -627,6 +762,10 @@ void Application::setScene1(uint32_t currentImage)
 		uboUpgrade.mMat = upgrades[i].getPosition4();
 		uboUpgrade.mvpMat = ViewPrjMat * uboUpgrade.mMat;
 		uboUpgrade.nMat = glm::inverse(glm::transpose(uboUpgrade.mMat));
+		upgradeLods[i] = MUpgrade.selectLod(uboUpgrade.mMat, ViewPrjMat, pixelsPerUnit(fov), upgradeLods[i]);
+		TUpgrade.requestResolution(MUpgrade.screenSize(uboUpgrade.mMat, ViewPrjMat, pixelsPerUnit(fov)));
+		LodDraws.set(currentImage, DRAW_UPGRADES + i, MUpgrade.lodDraw(upgradeLods[i]));
+		applyQuantization(uboUpgrade.mMat, uboUpgrade.mvpMat, MUpgrade);
 		DSUpgrades[i].map(currentImage, &uboUpgrade, 0);
 		DSUpgrades[i].map(currentImage, &uboToonParU, 2);
 	}
@@ -638,9 +777,12 @@ void Application::setScene1(uint32_t currentImage)
 	uboFloor.mMat = glm::mat4(1.0f);
 	uboFloor.mvpMat = ViewPrjMat * uboFloor.mMat;
 	uboFloor.nMat = glm::transpose(glm::inverse(uboFloor.mMat));
+	applyQuantization(uboFloor.mMat, uboFloor.mvpMat, MFloor);
 
 	DSFloor.map(currentImage, &uboFloor, 0);
 	DSFloor.map(currentImage, &uboToonParF, 2);
+	// the ground reaches the camera: one tile can cover the whole screen
+	TFloor.requestResolution(screenResolution());
 
 	// Update Grass uniforms
 	ToonUniformBufferObject uboGrass{};
@@ -649,9 +791,11 @@ void Application::setScene1(uint32_t currentImage)
 	uboGrass.mMat = glm::mat4(1.0f);
 	uboGrass.mvpMat = ViewPrjMat * uboGrass.mMat;
 	uboGrass.nMat = glm::transpose(glm::inverse(uboGrass.mMat));
+	applyQuantization(uboGrass.mMat, uboGrass.mvpMat, MGrass);
 
 	DSGrass.map(currentImage, &uboGrass, 0);
 	DSGrass.map(currentImage, &uboToonParG, 2);
+	TGrass.requestResolution(screenResolution());
 
 	// Update Fence uniforms
 	ToonUniformBufferObject uboFence{};
@@ -660,9 +804,11 @@ void Application::setScene1(uint32_t currentImage)
 	uboFence.mMat = glm::mat4(1.0f);
 	uboFence.mvpMat = ViewPrjMat * uboFence.mMat;
 	uboFence.nMat = glm::transpose(glm::inverse(uboFence.mMat));
+	applyQuantization(uboFence.mMat, uboFence.mvpMat, MFence);
 
 	DSFence.map(currentImage, &uboFence, 0);
 	DSFence.map(currentImage, &uboToonParFe, 2);
+	TFence.requestResolution(screenResolution());
 
 	// Update Skybox uniforms
 	SkyBoxUniformBufferObject uboSky{};
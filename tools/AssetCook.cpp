@@ -0,0 +1,108 @@
+// Asset cooker: bundles the models, textures and shaders read by the game into a single pack
+// (see AssetPack.hpp), which the game maps once at startup instead of opening each loose file.
+// Packed: OBJ/glTF/MGCG models with their mesh caches, PNG/JPEG images with their KTX2 files,
+// the compiled SPIR-V shaders and the texture atlas manifests. KTX2 files older than their
+// source image are left out, like the game does with loose ones; mesh caches are validated by
+// the game when loaded. The game reads the loose file of an asset instead when it differs in
+// size or contents from the packed one.
+// Cook the atlases (AtlasCook), then the textures (TextureCooker), and run the game once (to
+// write the mesh caches) before cooking the pack to get the most out of it.
+//
+// Usage (from the repository root): AssetCook [output] [root]
+// Defaults to assets.pack, from the models/, textures/ and shaders/ folders of the current directory.
+
+#include <AssetPack.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const char* folders[] = { "models", "textures", "shaders" };
+
+static std::vector<unsigned char> readAll(const fs::path& file) {
+	std::ifstream in(file, std::ios::ate | std::ios::binary);
+	if (!in.is_open()) {
+		throw std::runtime_error("failed to open " + file.string());
+	}
+	std::vector<unsigned char> data((size_t)in.tellg());
+	in.seekg(0);
+	in.read((char*)data.data(), data.size());
+	return data;
+}
+
+// A KTX2 file is stale when the image it was cooked from (X.png for X.png.ktx2) is newer
+static bool isStale(const fs::path& ktx2) {
+	fs::path source = ktx2;
+	source.replace_extension();
+	return fs::exists(source) && fs::last_write_time(source) > fs::last_write_time(ktx2);
+}
+
+int main(int argc, char** argv) {
+	fs::path output = argc > 1 ? argv[1] : "assets.pack";
+	fs::path root = argc > 2 ? argv[2] : ".";
+
+	try {
+		// sorted by name, so that the same inputs always give the same pack
+		std::map<std::string, fs::path> files;
+		int stale = 0;
+		for (const char* folder : folders) {
+			if (!fs::is_directory(root / folder)) {
+				std::cout << "Skipping missing folder " << (root / folder).string() << "\n";
+				continue;
+			}
+			for (const auto& entry : fs::recursive_directory_iterator(root / folder)) {
+				if (!entry.is_regular_file() || AssetPack::typeFromName(entry.path().string()) == AssetPack::TYPE_OTHER) {
+					continue;
+				}
+				if (AssetPack::typeFromName(entry.path().string()) == AssetPack::TYPE_KTX2 && isStale(entry.path())) {
+					std::cout << "Stale  : " << entry.path().string() << ", not packed\n";
+					stale++;
+					continue;
+				}
+				std::string name = AssetPack::normalizeName(fs::relative(entry.path(), root).string());
+				files[name] = entry.path();
+			}
+		}
+
+		std::vector<AssetPack::Source> assets;
+		std::map<std::string, std::pair<int, uint64_t>> totals;
+		for (const auto& [name, path] : files) {
+			assets.push_back({ name, readAll(path) });
+			auto& T = totals[AssetPack::typeName(AssetPack::typeFromName(name))];
+			T.first++;
+			T.second += assets.back().data.size();
+		}
+
+		fs::path tmp = output;
+		tmp += ".tmp";
+		{
+			std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) {
+				throw std::runtime_error("failed to write " + tmp.string());
+			}
+			AssetPack::write(out, assets);
+			if (!out.good()) {
+				throw std::runtime_error("failed to write " + tmp.string());
+			}
+		}
+		fs::rename(tmp, output);
+
+		for (const auto& [type, T] : totals) {
+			std::cout << T.first << " " << type << " files, " << T.second << " B\n";
+		}
+		std::cout << assets.size() << " assets packed into " << output.string() << " ("
+			<< fs::file_size(output) << " B), " << stale << " stale KTX2 files skipped\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+// Benchmark: reads the whole asset set (every file the asset cooker would pack, see
+// AssetCook.cpp) with blocking std::ifstream reads on one thread, as the loaders used to,
+// then with AsyncIO::Reader on io_uring and with its pread fallback. The same callback hands
+// each completed file to a decode worker, which hashes it here, so the benchmark doubles as a
+// correctness check against the blocking reads.
+// Cold runs drop the files from the page cache first (posix_fadvise DONTNEED). That only
+// evicts clean pages that are not mapped elsewhere: on a busy machine, run it as root after
+// "echo 1 > /proc/sys/vm/drop_caches" to be sure.
+//
+// Usage (from the repository root): AsyncIOBenchmark [iterations] [root]
+// Defaults to 5 warm iterations, from the models/, textures/ and shaders/ folders of the current directory.
+
+#include <AssetPack.hpp>
+#include <AsyncIO.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const char* folders[] = { "models", "textures", "shaders" };
+
+static void dropFromCache(const std::vector<std::string>& files) {
+#ifndef _WIN32
+	for (const auto& file : files) {
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd >= 0) {
+			fdatasync(fd);
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			close(fd);
+		}
+	}
+#else
+	(void)files;
+#endif
+}
+
+// Stand-in for the decode jobs of the game: one worker thread hashing the completed files
+class Decoder {
+public:
+	explicit Decoder(size_t count) : hashes(count), worker([this] { loop(); }) {}
+	~Decoder() {
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			quitting = true;
+			ready.notify_all();
+		}
+		worker.join();
+	}
+
+	void push(size_t index, std::vector<unsigned char>&& data) {
+		std::unique_lock<std::mutex> lock(mtx);
+		queue.push_back({ index, std::move(data) });
+		ready.notify_one();
+	}
+
+	void wait() {
+		std::unique_lock<std::mutex> lock(mtx);
+		idle.wait(lock, [this] { return queue.empty() && !busy; });
+	}
+
+	std::vector<uint64_t> hashes;
+
+private:
+	std::mutex mtx;
+	std::condition_variable ready, idle;
+	std::deque<std::pair<size_t, std::vector<unsigned char>>> queue;
+	bool quitting = false;
+	bool busy = false;
+	std::thread worker;
+
+	void loop() {
+		std::unique_lock<std::mutex> lock(mtx);
+		while (true) {
+			ready.wait(lock, [this] { return quitting || !queue.empty(); });
+			if (queue.empty()) {
+				return;
+			}
+			auto item = std::move(queue.front());
+			queue.pop_front();
+			busy = true;
+			lock.unlock();
+			hashes[item.first] = hashBytes(item.second.data(), item.second.size());
+			lock.lock();
+			busy = false;
+			if (queue.empty()) {
+				idle.notify_all();
+			}
+		}
+	}
+};
+
+static double blockingRun(const std::vector<std::string>& files, std::vector<uint64_t>& hashes) {
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < files.size(); i++) {
+		std::ifstream in(files[i], std::ios::ate | std::ios::binary);
+		if (!in.is_open()) {
+			throw std::runtime_error("failed to open " + files[i]);
+		}
+		std::vector<unsigned char> data((size_t)in.tellg());
+		in.seekg(0);
+		in.read((char*)data.data(), data.size());
+		hashes[i] = hashBytes(data.data(), data.size());
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// Returns the time from the first submission to the last decoded file
+static double readerRun(AsyncIO::Reader& reader, const std::vector<std::string>& files,
+	const std::vector<uint64_t>& expected, int& mismatches) {
+	Decoder decoder(files.size());
+	int failed = 0;
+	std::mutex failedMtx;
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < files.size(); i++) {
+		reader.read(files[i], [&, i](const std::string&, std::vector<unsigned char>& data, bool ok) {
+			if (!ok) {
+				std::lock_guard<std::mutex> lock(failedMtx);
+				failed++;
+				return;
+			}
+			decoder.push(i, std::move(data));
+		});
+	}
+	reader.wait();
+	decoder.wait();
+	auto t1 = std::chrono::high_resolution_clock::now();
+	mismatches = failed;
+	for (size_t i = 0; i < files.size(); i++) {
+		mismatches += decoder.hashes[i] != expected[i];
+	}
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 5;
+	fs::path root = argc > 2 ? argv[2] : ".";
+
+	try {
+		std::vector<std::string> files;
+		uint64_t totalBytes = 0;
+		for (const char* folder : folders) {
+			if (!fs::is_directory(root / folder)) {
+				continue;
+			}
+			for (const auto& entry : fs::recursive_directory_iterator(root / folder)) {
+				if (entry.is_regular_file() && AssetPack::typeFromName(entry.path().string()) != AssetPack::TYPE_OTHER) {
+					files.push_back(entry.path().string());
+					totalBytes += entry.file_size();
+				}
+			}
+		}
+		std::sort(files.begin(), files.end());
+		if (files.empty()) {
+			throw std::runtime_error("no assets under " + root.string());
+		}
+		std::cout << files.size() << " files, " << totalBytes / 1024 << " KB\n";
+
+		std::vector<uint64_t> expected(files.size());
+		AsyncIO::Reader uring, pread;
+		uring.start(true);
+		pread.start(false);
+		if (uring.backend() != AsyncIO::BACKEND_URING) {
+			std::cout << "io_uring not available (" << uring.fallbackReason() << "), measuring pread twice\n";
+		}
+
+		struct Mode {
+			const char* name;
+			AsyncIO::Reader* reader;
+		};
+		Mode modes[] = { { "blocking", nullptr }, { uring.backendName(), &uring }, { "pread", &pread } };
+		for (const Mode& M : modes) {
+			double cold = 0.0, warm = 1e30;
+			int mismatches = 0;
+			for (int i = 0; i <= iterations; i++) {
+				if (i == 0) {
+					dropFromCache(files);
+				}
+				double ms = M.reader ? readerRun(*M.reader, files, expected, mismatches) : blockingRun(files, expected);
+				if (i == 0) {
+					cold = ms;
+				}
+				else {
+					warm = std::min(warm, ms);
+				}
+			}
+			std::cout << M.name << ": cold " << cold << " ms (" << totalBytes / 1048576.0 / (cold / 1000.0)
+				<< " MB/s), warm " << warm << " ms (" << totalBytes / 1048576.0 / (warm / 1000.0) << " MB/s)";
+			if (M.reader) {
+				std::cout << ", " << mismatches << " mismatches";
+			}
+			std::cout << "\n";
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
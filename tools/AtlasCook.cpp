@@ -0,0 +1,201 @@
+// Texture atlas cooker: packs small textures into a few atlas images, so that the objects drawn
+// with them share one image (and one sampler) instead of binding a texture each.
+// Each texture is surrounded by a gutter of its own texels, wrapped around as a REPEAT sampler
+// would read them, and is placed at a multiple of the gutter size: mip levels up to
+// log2(gutter) are box filtered from texels of a single texture, and bilinear filtering
+// still finds a gutter texel around every texture at those levels. The game clamps the atlas
+// samplers at that level (the maxLod of the manifest).
+//
+// Writes <output>N.png for each atlas, and <output>.atlas, the manifest read by
+// BaseProject::loadAtlasManifest: one line per texture,
+//   tile <texture> <atlas image> <maxLod> <u scale> <v scale> <u offset> <v offset>
+// Models drawn with an atlased texture take the scale and offset into their UVs when they are
+// loaded (Model::uvScaleOffset), so their UVs must lie in [0,1]: the quantized UV layout of the
+// game clamps them there anyway. Textures sampled by one mesh with repeated UVs (the floor),
+// or several textures sampled by one mesh with the same UVs (the trophy), must stay out.
+// Run TextureCooker afterwards to cook the atlases like the other textures.
+//
+// Usage (from the repository root): AtlasCook [--gutter N] [--max-size N] [--output path] [textures...]
+// Defaults to a 32 texel gutter, atlases up to 4096x4096, textures/Atlas, and the small
+// palette textures of the game.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const char* defaultTextures[] = {
+	"textures/T_Car.png", "textures/Textures.png", "textures/T_Titles.png", "textures/T_Zebra.png"
+};
+
+struct Tile {
+	std::string file;
+	int width, height;
+	std::vector<unsigned char> pixels;	// RGBA8
+	int atlas = -1;
+	int x = 0, y = 0;					// of the gutter, in the atlas
+};
+
+// Shelf packer: tiles sorted by height fill rows from the left, rows stack from the top
+struct Atlas {
+	int width = 0, height = 0;
+	int rowX = 0, rowY = 0, rowHeight = 0;
+};
+
+static int alignUp(int v, int a) {
+	return (v + a - 1) / a * a;
+}
+
+static bool place(Atlas& A, int w, int h, int maxSize, int& x, int& y) {
+	if (A.rowX + w > maxSize) {
+		A.rowY += A.rowHeight;
+		A.rowX = 0;
+		A.rowHeight = 0;
+	}
+	if (w > maxSize || A.rowY + h > maxSize) {
+		return false;
+	}
+	x = A.rowX;
+	y = A.rowY;
+	A.rowX += w;
+	A.rowHeight = std::max(A.rowHeight, h);
+	A.width = std::max(A.width, A.rowX);
+	A.height = std::max(A.height, A.rowY + A.rowHeight);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	int gutter = 32;
+	int maxSize = 4096;
+	std::string output = "textures/Atlas";
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--gutter" && i + 1 < argc) {
+			gutter = atoi(argv[++i]);
+		}
+		else if (arg == "--max-size" && i + 1 < argc) {
+			maxSize = atoi(argv[++i]);
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty()) {
+		files.assign(std::begin(defaultTextures), std::end(defaultTextures));
+	}
+
+	try {
+		if (gutter < 1 || (gutter & (gutter - 1)) != 0) {
+			throw std::runtime_error("the gutter must be a power of two");
+		}
+		int maxLod = 0;
+		while ((1 << (maxLod + 1)) <= gutter) {
+			maxLod++;
+		}
+
+		std::vector<Tile> tiles;
+		for (const std::string& file : files) {
+			int w, h, channels;
+			stbi_uc* data = stbi_load(file.c_str(), &w, &h, &channels, STBI_rgb_alpha);
+			if (!data) {
+				throw std::runtime_error("failed to load " + file);
+			}
+			Tile T;
+			T.file = file;
+			T.width = w;
+			T.height = h;
+			T.pixels.assign(data, data + (size_t)w * h * 4);
+			stbi_image_free(data);
+			tiles.push_back(std::move(T));
+		}
+
+		std::vector<Tile*> order;
+		for (Tile& T : tiles) {
+			order.push_back(&T);
+		}
+		std::stable_sort(order.begin(), order.end(), [](const Tile* a, const Tile* b) {
+			return a->height > b->height;
+		});
+		std::vector<Atlas> atlases;
+		for (Tile* T : order) {
+			// the gutter is aligned too, so that every tile starts on a multiple of it
+			int w = alignUp(T->width + 2 * gutter, gutter);
+			int h = alignUp(T->height + 2 * gutter, gutter);
+			bool placed = false;
+			for (size_t a = 0; a < atlases.size() && !placed; a++) {
+				Atlas trial = atlases[a];
+				if (place(trial, w, h, maxSize, T->x, T->y)) {
+					atlases[a] = trial;
+					T->atlas = (int)a;
+					placed = true;
+				}
+			}
+			if (!placed) {
+				atlases.emplace_back();
+				if (!place(atlases.back(), w, h, maxSize, T->x, T->y)) {
+					throw std::runtime_error(T->file + " does not fit in a " + std::to_string(maxSize) + " texel atlas");
+				}
+				T->atlas = (int)atlases.size() - 1;
+			}
+		}
+
+		std::ofstream manifest(output + ".atlas", std::ios::trunc);
+		if (!manifest.is_open()) {
+			throw std::runtime_error("failed to write " + output + ".atlas");
+		}
+		manifest.precision(9);
+		manifest << "# written by AtlasCook: tile <texture> <atlas image> <maxLod> <u scale> <v scale> <u offset> <v offset>\n";
+		for (size_t a = 0; a < atlases.size(); a++) {
+			int W = atlases[a].width, H = atlases[a].height;
+			std::vector<unsigned char> image((size_t)W * H * 4, 0);
+			std::string name = output + std::to_string(a) + ".png";
+			int used = 0;
+			for (const Tile& T : tiles) {
+				if (T.atlas != (int)a) {
+					continue;
+				}
+				int w = alignUp(T.width + 2 * gutter, gutter);
+				int h = alignUp(T.height + 2 * gutter, gutter);
+				for (int y = 0; y < h; y++) {
+					int sy = ((y - gutter) % T.height + T.height) % T.height;
+					for (int x = 0; x < w; x++) {
+						int sx = ((x - gutter) % T.width + T.width) % T.width;
+						memcpy(&image[((size_t)(T.y + y) * W + T.x + x) * 4], &T.pixels[((size_t)sy * T.width + sx) * 4], 4);
+					}
+				}
+				used += T.width * T.height;
+				manifest << "tile " << T.file << " " << name << " " << maxLod << " "
+					<< (double)T.width / W << " " << (double)T.height / H << " "
+					<< (double)(T.x + gutter) / W << " " << (double)(T.y + gutter) / H << "\n";
+				std::cout << T.file << " -> " << name << " at " << T.x + gutter << "," << T.y + gutter << "\n";
+			}
+			if (!stbi_write_png(name.c_str(), W, H, 4, image.data(), W * 4)) {
+				throw std::runtime_error("failed to write " + name);
+			}
+			std::cout << name << ": " << W << "x" << H << ", " << 100.0 * used / ((double)W * H) << "% of the texels used\n";
+		}
+		if (!manifest) {
+			throw std::runtime_error("failed to write " + output + ".atlas");
+		}
+		std::cout << tiles.size() << " textures in " << atlases.size() << " atlases, mip levels up to " << maxLod << "\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
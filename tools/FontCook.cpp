@@ -0,0 +1,196 @@
+// Distance field font cooker: turns the largest bitmap font of textures/Fonts.png (font 0 of
+// Fonts.hpp, 73 texel lines) into a signed distance field atlas, textures/FontsSDF.png, and its
+// glyph table, libraries/FontsSDF.hpp. TextMaker draws it with TextSDFShader.frag, which finds
+// the outline of the glyphs at any size from the interpolated distance, and draws the border
+// and the shadow of the bitmap fonts from it too.
+// Each texel of the field covers unitsPerTexel x unitsPerTexel texels of the source glyph, and
+// stores the average of their signed distances to the outline (positive inside), in source
+// texels ("font units"), as 0.5 + d / (2 * spread). Glyphs are padded by spread font units, so
+// that the field reaches 0 around each of them.
+//
+// Usage (from the repository root): FontCook [--font N] [--units-per-texel N] [--spread N]
+// Defaults to font 0, 2 font units per texel and a spread of 10 font units.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#include <Fonts.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const char* sourceImage = "textures/Fonts.png";
+static const char* outputImage = "textures/FontsSDF.png";
+static const char* outputTable = "libraries/FontsSDF.hpp";
+static const int atlasWidth = 512;
+
+// Signed distance from the center of each texel of the glyph (padded by pad texels) to the
+// center of the nearest texel of the other side, moved by half a texel to the edge between them
+static std::vector<float> glyphDistances(const unsigned char* image, int imageWidth, const CharData& d, int pad, float spread) {
+	int w = d.width + 2 * pad, h = d.height + 2 * pad;
+	std::vector<unsigned char> inside((size_t)w * h, 0);
+	for (int y = 0; y < d.height; y++) {
+		for (int x = 0; x < d.width; x++) {
+			// the red channel holds the glyph, green its border and blue its shadow
+			inside[(size_t)(y + pad) * w + x + pad] = image[((size_t)(d.y + y) * imageWidth + d.x + x) * 4] >= 128;
+		}
+	}
+	int radius = (int)std::ceil(spread) + 1;
+	std::vector<float> distances((size_t)w * h);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			unsigned char side = inside[(size_t)y * w + x];
+			float best = (float)radius;
+			for (int v = std::max(y - radius, 0); v <= std::min(y + radius, h - 1); v++) {
+				for (int u = std::max(x - radius, 0); u <= std::min(x + radius, w - 1); u++) {
+					if (inside[(size_t)v * w + u] != side) {
+						best = std::min(best, std::sqrt((float)((u - x) * (u - x) + (v - y) * (v - y))) - 0.5f);
+					}
+				}
+			}
+			distances[(size_t)y * w + x] = side ? best : -best;
+		}
+	}
+	return distances;
+}
+
+int main(int argc, char** argv) {
+	int fontId = 0;
+	int unitsPerTexel = 2;
+	float spread = 10.0f;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		if (arg == "--font") {
+			fontId = atoi(argv[i + 1]);
+		}
+		else if (arg == "--units-per-texel") {
+			unitsPerTexel = std::max(1, atoi(argv[i + 1]));
+		}
+		else if (arg == "--spread") {
+			spread = (float)atof(argv[i + 1]);
+		}
+	}
+
+	try {
+		if (fontId < 0 || fontId >= (int)Fonts.size()) {
+			throw std::runtime_error("no font " + std::to_string(fontId) + " in Fonts.hpp");
+		}
+		const FontDef& F = Fonts[fontId];
+		int imageWidth, imageHeight, channels;
+		stbi_uc* image = stbi_load(sourceImage, &imageWidth, &imageHeight, &channels, STBI_rgb_alpha);
+		if (!image) {
+			throw std::runtime_error(std::string("failed to load ") + sourceImage);
+		}
+
+		// glyph sizes in texels of the field, padded by the spread
+		int pad = (int)std::ceil(spread / unitsPerTexel);
+		std::vector<CharData> glyphs(F.P.size());
+		std::vector<int> order;
+		for (size_t c = 0; c < F.P.size(); c++) {
+			const CharData& d = F.P[c];
+			CharData& g = glyphs[c];
+			g = { 0, 0, 0, 0, 0, 0, d.xadvance };
+			if (d.width > 0 && d.height > 0) {
+				g.width = (d.width + unitsPerTexel - 1) / unitsPerTexel + 2 * pad;
+				g.height = (d.height + unitsPerTexel - 1) / unitsPerTexel + 2 * pad;
+				g.xoffset = d.xoffset - pad * unitsPerTexel;
+				g.yoffset = d.yoffset - pad * unitsPerTexel;
+				order.push_back((int)c);
+			}
+		}
+
+		// shelf packing, tallest glyphs first, one texel apart
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return glyphs[a].height > glyphs[b].height; });
+		int x = 0, y = 0, rowHeight = 0;
+		for (int c : order) {
+			CharData& g = glyphs[c];
+			if (x + g.width > atlasWidth) {
+				x = 0;
+				y += rowHeight + 1;
+				rowHeight = 0;
+			}
+			g.x = x;
+			g.y = y;
+			x += g.width + 1;
+			rowHeight = std::max(rowHeight, g.height);
+		}
+		int atlasHeight = 1;
+		while (atlasHeight < y + rowHeight) {
+			atlasHeight *= 2;
+		}
+
+		std::vector<unsigned char> atlas((size_t)atlasWidth * atlasHeight, 0);
+		for (int c : order) {
+			const CharData& d = F.P[c];
+			const CharData& g = glyphs[c];
+			// source texels are padded to whole texels of the field
+			int sourcePad = pad * unitsPerTexel;
+			std::vector<float> distances = glyphDistances(image, imageWidth, d, sourcePad, spread);
+			int sw = d.width + 2 * sourcePad, sh = d.height + 2 * sourcePad;
+			for (int j = 0; j < g.height; j++) {
+				for (int i = 0; i < g.width; i++) {
+					float sum = 0.0f;
+					int count = 0;
+					for (int v = j * unitsPerTexel; v < std::min((j + 1) * unitsPerTexel, sh); v++) {
+						for (int u = i * unitsPerTexel; u < std::min((i + 1) * unitsPerTexel, sw); u++) {
+							sum += distances[(size_t)v * sw + u];
+							count++;
+						}
+					}
+					// texels past the source glyph are outside
+					float distance = count > 0 ? sum / count : -spread;
+					float value = std::min(std::max(0.5f + distance / (2.0f * spread), 0.0f), 1.0f);
+					atlas[(size_t)(g.y + j) * atlasWidth + g.x + i] = (unsigned char)std::lround(value * 255.0f);
+				}
+			}
+		}
+		stbi_image_free(image);
+
+		if (!stbi_write_png(outputImage, atlasWidth, atlasHeight, 1, atlas.data(), atlasWidth)) {
+			throw std::runtime_error(std::string("failed to write ") + outputImage);
+		}
+
+		std::ofstream out(outputTable, std::ios::trunc);
+		if (!out.is_open()) {
+			throw std::runtime_error(std::string("failed to write ") + outputTable);
+		}
+		out << "#pragma once\n"
+			<< "// Distance field font written by FontCook from font " << fontId << " of Fonts.hpp: cook it again instead of\n"
+			<< "// editing it. x, y, width and height are in texels of textures/FontsSDF.png, offsets and\n"
+			<< "// advances in font units (texels of the source font), FONT_SDF_UNITS_PER_TEXEL per texel of\n"
+			<< "// the field. The field stores 0.5 + d / (2 * FONT_SDF_SPREAD), d the signed distance in font\n"
+			<< "// units from the outline of the glyph, positive inside.\n\n"
+			<< "#include \"Fonts.hpp\"\n\n"
+			<< "const int FONT_SDF_WIDTH = " << atlasWidth << ";\n"
+			<< "const int FONT_SDF_HEIGHT = " << atlasHeight << ";\n"
+			<< "const int FONT_SDF_UNITS_PER_TEXEL = " << unitsPerTexel << ";\n"
+			<< "const float FONT_SDF_SPREAD = " << std::fixed << std::setprecision(1) << spread << "f;\n\n"
+			<< "const FontDef FontSDF = { " << F.lineHeight << ",{";
+		for (size_t c = 0; c < glyphs.size(); c++) {
+			const CharData& g = glyphs[c];
+			out << (c > 0 ? "," : "") << (c > 0 && c % 32 == 0 ? "\n" : "") << "{" << g.x << "," << g.y << "," << g.width << "," << g.height
+				<< "," << g.xoffset << "," << g.yoffset << "," << g.xadvance << "}";
+		}
+		out << "} };\n";
+		if (!out) {
+			throw std::runtime_error(std::string("failed to write ") + outputTable);
+		}
+
+		std::cout << glyphs.size() << " glyphs of font " << fontId << " (" << F.lineHeight << " texel lines) -> "
+			<< outputImage << ": " << atlasWidth << "x" << atlasHeight << ", " << (atlasWidth * atlasHeight) / 1024
+			<< " KB as R8, " << unitsPerTexel << " font units per texel, spread " << spread << "\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+// Microbenchmark: streaming OBJ parser (ObjParser.hpp) vs the former tinyobj-based loader.
+// Both paths produce the game's GenericVertex layout (pos, UV, normal); the output of the two
+// is compared corner by corner, so the benchmark doubles as a correctness check. Polygons with
+// more than four corners are fanned by ObjParser but ear-clipped by tinyobj: their corners show
+// up as mismatches even though both cover the same surface.
+//
+// Usage (from the repository root): ObjParserBenchmark [iterations] [file.obj ...]
+// Defaults to models/Title1.obj and models/Fence.obj.
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+#include <ObjParser.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Same layout as GenericVertex in include/Utils.hpp
+struct Vertex {
+	float pos[3];
+	float norm[3];
+	float UV[2];
+};
+
+static const ObjVertexLayout layout = { sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, norm), offsetof(Vertex, UV), -1 };
+
+static uint64_t hashBytes(const void* data, size_t size) {
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+// The previous Model::loadModelOBJ: tinyobj tables, a temporary vector per corner, welding
+// through a std::unordered_set keyed on the vertex bytes
+static void loadTinyObj(const std::string& file, std::vector<unsigned char>& vertices, std::vector<uint32_t>& indices) {
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file.c_str())) {
+		throw std::runtime_error(warn + err);
+	}
+	int mainStride = layout.stride;
+	auto vertexHash = [&](uint32_t i) {
+		return (size_t)hashBytes(&vertices[(size_t)i * mainStride], mainStride);
+	};
+	auto vertexEqual = [&](uint32_t a, uint32_t b) {
+		return memcmp(&vertices[(size_t)a * mainStride], &vertices[(size_t)b * mainStride], mainStride) == 0;
+	};
+	size_t corners = 0;
+	for (const auto& shape : shapes) {
+		corners += shape.mesh.indices.size();
+	}
+	std::unordered_set<uint32_t, decltype(vertexHash), decltype(vertexEqual)> uniqueVertices(corners, vertexHash, vertexEqual);
+
+	for (const auto& shape : shapes) {
+		for (const auto& index : shape.mesh.indices) {
+			std::vector<unsigned char> vertex(mainStride, 0);
+			Vertex* v = (Vertex*)vertex.data();
+			for (int i = 0; i < 3; i++) {
+				v->pos[i] = attrib.vertices[3 * index.vertex_index + i];
+			}
+			if (index.texcoord_index >= 0) {
+				v->UV[0] = attrib.texcoords[2 * index.texcoord_index + 0];
+				v->UV[1] = 1 - attrib.texcoords[2 * index.texcoord_index + 1];
+			}
+			if (index.normal_index >= 0) {
+				for (int i = 0; i < 3; i++) {
+					v->norm[i] = attrib.normals[3 * index.normal_index + i];
+				}
+			}
+			uint32_t candidate = (uint32_t)(vertices.size() / mainStride);
+			vertices.insert(vertices.end(), vertex.begin(), vertex.end());
+			auto found = uniqueVertices.insert(candidate);
+			if (!found.second) {
+				vertices.resize((size_t)candidate * mainStride);
+			}
+			indices.push_back(*found.first);
+		}
+	}
+}
+
+static std::vector<char> readWholeFile(const std::string& file) {
+	std::ifstream in(file, std::ios::ate | std::ios::binary);
+	if (!in.is_open()) {
+		throw std::runtime_error("failed to open " + file);
+	}
+	std::vector<char> buffer((size_t)in.tellg());
+	in.seekg(0);
+	in.read(buffer.data(), buffer.size());
+	return buffer;
+}
+
+// Compares the de-indexed triangle corners of the two loaders
+static size_t countMismatches(const std::vector<unsigned char>& vA, const std::vector<uint32_t>& iA,
+	const std::vector<unsigned char>& vB, const std::vector<uint32_t>& iB) {
+	if (iA.size() != iB.size()) {
+		return std::max(iA.size(), iB.size());
+	}
+	size_t bad = 0;
+	for (size_t i = 0; i < iA.size(); i++) {
+		const float* a = (const float*)&vA[(size_t)iA[i] * layout.stride];
+		const float* b = (const float*)&vB[(size_t)iB[i] * layout.stride];
+		for (int c = 0; c < 8; c++) {
+			if (std::fabs(a[c] - b[c]) > 1e-6f * std::fmax(1.0f, std::fabs(a[c]))) {
+				bad++;
+				break;
+			}
+		}
+	}
+	return bad;
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? std::atoi(argv[1]) : 10;
+	std::vector<std::string> files;
+	for (int i = 2; i < argc; i++) {
+		files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		files = { "models/Title1.obj", "models/Fence.obj" };
+	}
+
+	try {
+		for (const auto& file : files) {
+			std::vector<char> source = readWholeFile(file);
+			double tinyMs = 1e30, streamMs = 1e30;
+			std::vector<unsigned char> vTiny, vStream;
+			std::vector<uint32_t> iTiny, iStream;
+			size_t corners = 0;
+
+			for (int it = 0; it < iterations; it++) {
+				vTiny.clear();
+				iTiny.clear();
+				auto t0 = std::chrono::high_resolution_clock::now();
+				loadTinyObj(file, vTiny, iTiny);
+				auto t1 = std::chrono::high_resolution_clock::now();
+				// the game mmaps the file; reading it is left out of the streaming timing on purpose
+				corners = ObjParser::parse(source.data(), source.size(), layout, vStream, iStream);
+				auto t2 = std::chrono::high_resolution_clock::now();
+				tinyMs = std::min(tinyMs, std::chrono::duration<double, std::milli>(t1 - t0).count());
+				streamMs = std::min(streamMs, std::chrono::duration<double, std::milli>(t2 - t1).count());
+			}
+
+			double mb = source.size() / (1024.0 * 1024.0);
+			std::cout << file << " (" << source.size() / 1024 << " KB, " << corners << " corners)\n";
+			std::cout << "  tinyobj   : " << tinyMs << " ms, " << mb / (tinyMs / 1000.0) << " MB/s, "
+				<< vTiny.size() / layout.stride << " vertices (welded)\n";
+			std::cout << "  streaming : " << streamMs << " ms, " << mb / (streamMs / 1000.0) << " MB/s, "
+				<< vStream.size() / layout.stride << " vertices (welded)\n";
+			std::cout << "  speedup   : " << tinyMs / streamMs << "x, mismatching corners: "
+				<< countMismatches(vTiny, iTiny, vStream, iStream) << "\n";
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
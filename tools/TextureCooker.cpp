@@ -0,0 +1,467 @@
+// Offline texture cooker: converts every PNG/JPEG of a folder into a KTX2 file next to it
+// (X.png -> X.png.ktx2), block compressed and with its whole mip chain, ready to be copied
+// into a VkImage by Texture::loadTextureImages. Opaque images become BC1 (8 bytes per 4x4 block), images with
+// alpha BC3 (16 bytes per block). The game still reads BC7 files made by other tools, but
+// this cooker does not write them.
+// Mip levels are box filtered in linear light, so the sources are assumed to be sRGB, as all the
+// textures of the game are; the files are tagged sRGB and the game reinterprets them as UNORM
+// when a texture is created with a linear format.
+//
+// Images that block compression would visibly damage (level 0 under minPsnr, e.g. small
+// palette textures with four unrelated colors per block) are left uncompressed.
+// Distance fields (*SDF.png, written by FontCook) are skipped: they hold linear distances,
+// which sRGB mip filtering and block compression would both move off the outline.
+//
+// Usage (from the repository root): TextureCooker [--force] [folder]
+// Defaults to textures/. Up to date KTX2 files are skipped unless --force is given.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <Ktx2.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const double minPsnr = 32.0;
+
+struct Color {
+	float r, g, b;
+};
+
+static float srgbToLinear[256];
+
+static void initTables() {
+	for (int i = 0; i < 256; i++) {
+		float c = i / 255.0f;
+		srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+}
+
+static unsigned char linearToSrgb(float c) {
+	c = std::min(std::max(c, 0.0f), 1.0f);
+	float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	return (unsigned char)(s * 255.0f + 0.5f);
+}
+
+// Next mip level of an RGBA8 sRGB image: 2x2 box filter in linear light, odd sizes clamp
+static std::vector<unsigned char> downsample(const std::vector<unsigned char>& src, int w, int h, int& nw, int& nh) {
+	nw = std::max(w / 2, 1);
+	nh = std::max(h / 2, 1);
+	std::vector<unsigned char> dst((size_t)nw * nh * 4);
+	for (int y = 0; y < nh; y++) {
+		for (int x = 0; x < nw; x++) {
+			float sum[4] = {};
+			for (int dy = 0; dy < 2; dy++) {
+				for (int dx = 0; dx < 2; dx++) {
+					int sx = std::min(2 * x + dx, w - 1);
+					int sy = std::min(2 * y + dy, h - 1);
+					const unsigned char* p = &src[((size_t)sy * w + sx) * 4];
+					for (int c = 0; c < 3; c++) {
+						sum[c] += srgbToLinear[p[c]];
+					}
+					sum[3] += p[3];
+				}
+			}
+			unsigned char* q = &dst[((size_t)y * nw + x) * 4];
+			for (int c = 0; c < 3; c++) {
+				q[c] = linearToSrgb(sum[c] / 4.0f);
+			}
+			q[3] = (unsigned char)(sum[3] / 4.0f + 0.5f);
+		}
+	}
+	return dst;
+}
+
+static uint16_t packRGB565(const Color& c) {
+	int r = (int)(std::min(std::max(c.r, 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(std::min(std::max(c.g, 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(std::min(std::max(c.b, 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static Color unpackRGB565(uint16_t v) {
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	return { (float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)) };
+}
+
+static float distance2(const Color& a, const Color& b) {
+	float dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+	return dr * dr + dg * dg + db * db;
+}
+
+// Picks the nearest of the four palette entries for each texel; returns the squared error of
+// the texels with a non-zero weight
+static float selectIndices(const Color texels[16], const float weights[16], uint16_t c0, uint16_t c1, uint32_t& indices) {
+	Color p[4];
+	p[0] = unpackRGB565(c0);
+	p[1] = unpackRGB565(c1);
+	p[2] = { (2 * p[0].r + p[1].r) / 3, (2 * p[0].g + p[1].g) / 3, (2 * p[0].b + p[1].b) / 3 };
+	p[3] = { (p[0].r + 2 * p[1].r) / 3, (p[0].g + 2 * p[1].g) / 3, (p[0].b + 2 * p[1].b) / 3 };
+	indices = 0;
+	float error = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0;
+		float bestDistance = distance2(texels[i], p[0]);
+		for (int j = 1; j < 4; j++) {
+			float d = distance2(texels[i], p[j]);
+			if (d < bestDistance) {
+				bestDistance = d;
+				best = j;
+			}
+		}
+		indices |= (uint32_t)best << (2 * i);
+		error += weights[i] * bestDistance;
+	}
+	return error;
+}
+
+// Least squares endpoints for a given index assignment
+static bool refineEndpoints(const Color texels[16], const float weights[16], uint32_t indices, Color& e0, Color& e1) {
+	static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0, ab = 0, bb = 0;
+	Color ax = { 0, 0, 0 }, bx = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		float a = weight0[(indices >> (2 * i)) & 3], b = 1.0f - a, w = weights[i];
+		aa += w * a * a;
+		ab += w * a * b;
+		bb += w * b * b;
+		ax.r += w * a * texels[i].r; ax.g += w * a * texels[i].g; ax.b += w * a * texels[i].b;
+		bx.r += w * b * texels[i].r; bx.g += w * b * texels[i].g; bx.b += w * b * texels[i].b;
+	}
+	float det = aa * bb - ab * ab;
+	if (std::fabs(det) < 1e-6f) {
+		return false;
+	}
+	float inv = 1.0f / det;
+	e0 = { (bb * ax.r - ab * bx.r) * inv, (bb * ax.g - ab * bx.g) * inv, (bb * ax.b - ab * bx.b) * inv };
+	e1 = { (aa * bx.r - ab * ax.r) * inv, (aa * bx.g - ab * ax.g) * inv, (aa * bx.b - ab * ax.b) * inv };
+	return true;
+}
+
+// Four-color BC1 block: endpoints along the principal axis of the texels, one refinement pass.
+// With ignoreTransparent, the color of fully transparent texels does not matter.
+// Returns the squared error of the block, and the number of texels it was measured on.
+static float encodeColorBlock(const unsigned char rgba[64], bool ignoreTransparent, unsigned char out[8], int& measured) {
+	Color texels[16];
+	float weights[16];
+	Color mean = { 0, 0, 0 };
+	measured = 0;
+	for (int i = 0; i < 16; i++) {
+		texels[i] = { (float)rgba[4 * i], (float)rgba[4 * i + 1], (float)rgba[4 * i + 2] };
+		weights[i] = ignoreTransparent && rgba[4 * i + 3] == 0 ? 0.0f : 1.0f;
+		if (weights[i] > 0) {
+			mean.r += texels[i].r; mean.g += texels[i].g; mean.b += texels[i].b;
+			measured++;
+		}
+	}
+	if (measured == 0) {
+		memset(out, 0, 8);
+		return 0;
+	}
+	mean = { mean.r / measured, mean.g / measured, mean.b / measured };
+
+	float cov[6] = {};
+	for (int i = 0; i < 16; i++) {
+		float r = texels[i].r - mean.r, g = texels[i].g - mean.g, b = texels[i].b - mean.b;
+		r *= weights[i];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g * weights[i]; cov[4] += g * b * weights[i]; cov[5] += b * b * weights[i];
+	}
+	Color axis = { 1, 1, 1 };
+	for (int it = 0; it < 8; it++) {
+		Color n = { cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+					cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+					cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b };
+		float len = std::max(std::fabs(n.r), std::max(std::fabs(n.g), std::fabs(n.b)));
+		if (len < 1e-6f) {
+			break;
+		}
+		axis = { n.r / len, n.g / len, n.b / len };
+	}
+
+	int minI = 0, maxI = 0;
+	float minP = 1e30f, maxP = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		if (weights[i] == 0) {
+			continue;
+		}
+		float p = texels[i].r * axis.r + texels[i].g * axis.g + texels[i].b * axis.b;
+		if (p < minP) { minP = p; minI = i; }
+		if (p > maxP) { maxP = p; maxI = i; }
+	}
+
+	uint16_t c0 = packRGB565(texels[maxI]), c1 = packRGB565(texels[minI]);
+	uint32_t indices;
+	float error = selectIndices(texels, weights, c0, c1, indices);
+
+	Color e0, e1;
+	if (refineEndpoints(texels, weights, indices, e0, e1)) {
+		uint16_t r0 = packRGB565(e0), r1 = packRGB565(e1);
+		uint32_t refined;
+		float refinedError = selectIndices(texels, weights, r0, r1, refined);
+		if (refinedError < error) {
+			c0 = r0;
+			c1 = r1;
+			indices = refined;
+			error = refinedError;
+		}
+	}
+
+	// c0 > c1 selects the four-color mode; swapping the endpoints swaps indices 0<->1 and 2<->3
+	if (c0 < c1) {
+		std::swap(c0, c1);
+		indices ^= 0x55555555u;
+	}
+	else if (c0 == c1) {
+		indices = 0;
+	}
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+	for (int i = 0; i < 4; i++) {
+		out[4 + i] = (indices >> (8 * i)) & 0xFF;
+	}
+	return error;
+}
+
+// Alpha half of a BC3 block: tries the eight-value ramp between the extremes and the six-value
+// ramp that keeps exact 0 and 255, and keeps the one with the lower error
+static void encodeAlphaBlock(const unsigned char rgba[64], unsigned char out[8]) {
+	int lo = 255, hi = 0, lo6 = 255, hi6 = 0;
+	for (int i = 0; i < 16; i++) {
+		int a = rgba[4 * i + 3];
+		lo = std::min(lo, a);
+		hi = std::max(hi, a);
+		if (a != 0 && a != 255) {
+			lo6 = std::min(lo6, a);
+			hi6 = std::max(hi6, a);
+		}
+	}
+	if (lo6 > hi6) {
+		lo6 = hi6 = lo;
+	}
+
+	int bestError = -1;
+	for (int mode = 0; mode < 2; mode++) {
+		int a0 = mode == 0 ? hi : lo6, a1 = mode == 0 ? lo : hi6;
+		if (mode == 0 && a0 == a1) {
+			continue;	// a0 > a1 is needed for the eight-value ramp
+		}
+		int palette[8] = { a0, a1 };
+		if (mode == 0) {
+			for (int j = 1; j < 7; j++) {
+				palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+			}
+		}
+		else {
+			for (int j = 1; j < 5; j++) {
+				palette[j + 1] = ((5 - j) * a0 + j * a1) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t bits = 0;
+		int error = 0;
+		for (int i = 0; i < 16; i++) {
+			int a = rgba[4 * i + 3], best = 0, bestDistance = 1 << 30;
+			for (int j = 0; j < 8; j++) {
+				int d = (a - palette[j]) * (a - palette[j]);
+				if (d < bestDistance) {
+					bestDistance = d;
+					best = j;
+				}
+			}
+			bits |= (uint64_t)best << (3 * i);
+			error += bestDistance;
+		}
+		if (bestError < 0 || error < bestError) {
+			bestError = error;
+			out[0] = (unsigned char)a0;
+			out[1] = (unsigned char)a1;
+			for (int i = 0; i < 6; i++) {
+				out[2 + i] = (bits >> (8 * i)) & 0xFF;
+			}
+		}
+	}
+}
+
+// Encodes one level; blocks on the right and bottom edges repeat the last column and row.
+// psnr receives the quality of the color channels.
+static std::vector<unsigned char> encodeLevel(const std::vector<unsigned char>& rgba, int w, int h, bool alpha, double& psnr) {
+	int bw = (w + 3) / 4, bh = (h + 3) / 4;
+	size_t blockSize = alpha ? 16 : 8;
+	std::vector<unsigned char> out((size_t)bw * bh * blockSize);
+
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	std::vector<double> errors(threads, 0.0);
+	std::vector<size_t> texels(threads, 0);
+	for (unsigned t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			unsigned char block[64];
+			int measured;
+			for (int by = (int)t; by < bh; by += (int)threads) {
+				for (int bx = 0; bx < bw; bx++) {
+					for (int i = 0; i < 16; i++) {
+						int x = std::min(bx * 4 + (i & 3), w - 1);
+						int y = std::min(by * 4 + (i >> 2), h - 1);
+						memcpy(&block[4 * i], &rgba[((size_t)y * w + x) * 4], 4);
+					}
+					unsigned char* dst = &out[((size_t)by * bw + bx) * blockSize];
+					if (alpha) {
+						encodeAlphaBlock(block, dst);
+						dst += 8;
+					}
+					errors[t] += encodeColorBlock(block, alpha, dst, measured);
+					texels[t] += measured;
+				}
+			}
+		});
+	}
+	double error = 0;
+	size_t count = 0;
+	for (unsigned t = 0; t < threads; t++) {
+		workers[t].join();
+		error += errors[t];
+		count += texels[t];
+	}
+	// the edge blocks count their repeated texels too, which is close enough for a quality gate
+	double mse = count > 0 ? error / (3.0 * count) : 0.0;
+	psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	return out;
+}
+
+// Returns false if the image was left uncompressed
+static bool cook(const fs::path& source, const fs::path& target) {
+	auto t0 = std::chrono::high_resolution_clock::now();
+	int w, h, channels;
+	stbi_uc* pixels = stbi_load(source.string().c_str(), &w, &h, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("failed to load " + source.string());
+	}
+	std::vector<unsigned char> level(pixels, pixels + (size_t)w * h * 4);
+	stbi_image_free(pixels);
+
+	bool alpha = false;
+	for (size_t i = 3; i < level.size(); i += 4) {
+		if (level[i] != 255) {
+			alpha = true;
+			break;
+		}
+	}
+	uint32_t format = alpha ? Ktx2::FORMAT_BC3_SRGB : Ktx2::FORMAT_BC1_RGB_SRGB;
+
+	std::vector<std::vector<unsigned char>> levels;
+	size_t rawBytes = 0, cookedBytes = 0;
+	double psnr = 0;
+	int lw = w, lh = h;
+	while (true) {
+		double levelPsnr;
+		levels.push_back(encodeLevel(level, lw, lh, alpha, levelPsnr));
+		if (levels.size() == 1) {
+			psnr = levelPsnr;
+			if (psnr < minPsnr) {
+				std::cout << source.string() << ": " << Ktx2::formatName(format) << " would only reach "
+					<< psnr << " dB, left uncompressed\n";
+				return false;
+			}
+		}
+		rawBytes += level.size();
+		cookedBytes += levels.back().size();
+		if (lw == 1 && lh == 1) {
+			break;
+		}
+		int nw, nh;
+		level = downsample(level, lw, lh, nw, nh);
+		lw = nw;
+		lh = nh;
+	}
+
+	fs::path temporary = target;
+	temporary += ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			throw std::runtime_error("failed to write " + temporary.string());
+		}
+		Ktx2::write(out, format, (uint32_t)w, (uint32_t)h, levels);
+		if (!out) {
+			throw std::runtime_error("failed to write " + temporary.string());
+		}
+	}
+	fs::rename(temporary, target);
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	std::cout << source.string() << " -> " << target.filename().string() << ": " << w << "x" << h << ", "
+		<< Ktx2::formatName(format) << ", " << levels.size() << " levels, "
+		<< rawBytes / 1024 << " KB -> " << cookedBytes / 1024 << " KB, " << psnr << " dB, "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+	return true;
+}
+
+int main(int argc, char** argv) {
+	bool force = false;
+	fs::path folder = "textures";
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--force") {
+			force = true;
+		}
+		else {
+			folder = argv[i];
+		}
+	}
+	initTables();
+
+	try {
+		int cookedCount = 0, skipped = 0, uncompressed = 0;
+		for (const auto& entry : fs::directory_iterator(folder)) {
+			if (!entry.is_regular_file()) {
+				continue;
+			}
+			std::string ext = entry.path().extension().string();
+			std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+			if (ext != ".png" && ext != ".jpg" && ext != ".jpeg") {
+				continue;
+			}
+			std::string stem = entry.path().stem().string();
+			if (stem.size() >= 3 && stem.compare(stem.size() - 3, 3, "SDF") == 0) {
+				continue;	// distance fields are not colors, see the header
+			}
+			// X.png -> X.png.ktx2, as cookedTextureFile() in starter.hpp: X.jpg has its own twin
+			fs::path target = entry.path();
+			target += ".ktx2";
+			if (!force && fs::exists(target) && fs::last_write_time(target) >= entry.last_write_time()) {
+				skipped++;
+				continue;
+			}
+			if (cook(entry.path(), target)) {
+				cookedCount++;
+			}
+			else {
+				fs::remove(target);
+				uncompressed++;
+			}
+		}
+		std::cout << cookedCount << " textures cooked, " << skipped << " up to date, "
+			<< uncompressed << " left uncompressed\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
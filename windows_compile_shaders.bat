@@ -2,6 +2,7 @@
 
 @echo off
 set glslc="C:\VulkanSDK\Bin\glslc.exe"
+set spirv_val="C:\VulkanSDK\Bin\spirv-val.exe"
 set shader_dir=.\computer-graphics-project-2024\shaders\
 for %%f in (%shader_dir%*.frag %shader_dir%*.vert) do (
     call :CompileShader "%%f"
@@ -18,4 +19,6 @@ set output_dir=%~dp1
 set output_file=%output_dir%%shader_name%Frag.spv
 if "%~x1"==".vert" set output_file=%output_dir%%shader_name%Vert.spv
 %glslc% "%input_file%" -o "%output_file%"
+:: the driver only reports a malformed module at pipeline creation
+%spirv_val% --target-env vulkan1.0 "%output_file%" || echo Invalid SPIR-V: %output_file%
 exit /b